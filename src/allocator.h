@@ -16,13 +16,15 @@
     void (*dealloc)(u8*);
   } allocator_t;
 
+  // atomic so trees can be built and torn down from several threads (what
+  // simplify_persistent() and integrate() callers on threads rely on)
   static u8 *gpa_alloc(usize size) {
-    __active_gpa_allocations++;
+    __atomic_add_fetch(&__active_gpa_allocations, 1, __ATOMIC_RELAXED);
     return (u8*)malloc(size);
   }
 
   static void gpa_dealloc(u8 *allocation) {
-    __active_gpa_allocations--;
+    __atomic_sub_fetch(&__active_gpa_allocations, 1, __ATOMIC_RELAXED);
     free(allocation);
   }
 
@@ -0,0 +1,188 @@
+#ifndef _LIBSEQ_CANONICAL_H
+#define _LIBSEQ_CANONICAL_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+
+// canonical form: sums and products are flattened into one operand list,
+// sorted by expr_compare() and rebuilt as a left leaning chain
+// (((a+b)+c)+d), so any two trees that only differ in how a sum or
+// product was grouped or ordered come out identical. everything else is
+// copied as is (no folding, that's simplify()'s job).
+//
+// expr_fingerprint() hashes a tree structurally (no pointers), so the
+// fingerprint of a canonical tree is stable across runs and processes.
+
+typedef struct {
+  u64 hi, lo;
+} expr_fingerprint_t;
+
+// total order on trees: by variant, then constant value (ties such as 0
+// and -0 broken on the bits), variable name, and children left to right.
+// constants sort first, so coefficients lead a product (2*x, not x*2)
+i32 expr_compare(expr_t *a, expr_t *b) {
+  if (expr_variant(a) != expr_variant(b)) return (expr_variant(a) < expr_variant(b)) ? -1 : 1;
+
+  switch (expr_variant(a)) {
+    case EXPR_CONSTANT: {
+      f64 ac = expr_constant(a), bc = expr_constant(b);
+      if (ac < bc) return -1;
+      if (ac > bc) return 1;
+
+      u64 abits, bbits;
+      memcpy(&abits, &ac, sizeof(u64));
+      memcpy(&bbits, &bc, sizeof(u64));
+      return (abits > bbits) - (abits < bbits);
+    }
+
+    case EXPR_VARIABLE: return (expr_variable(a) > expr_variable(b)) - (expr_variable(a) < expr_variable(b));
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: {
+      i32 order = expr_compare(a->args.x, b->args.x);
+      return (order != 0) ? order : expr_compare(a->args.y, b->args.y);
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: return expr_compare(a->arg.x, b->arg.x);
+
+    default:
+      puts("expr_compare: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+static usize count_chain_operands(expr_t *e, expr_tag_t variant) {
+  if (expr_variant(e) != variant) return 1;
+  return count_chain_operands(e->args.x, variant) + count_chain_operands(e->args.y, variant);
+}
+
+expr_t *canonicalize_expr(expr_t *e, allocator_t *allocator);
+
+// canonical child slot, leaves go inline where they fit
+static expr_t *canonicalize_child(expr_t *e, allocator_t *allocator) {
+  expr_tag_t variant = expr_variant(e);
+  if ((variant == EXPR_CONSTANT) || (variant == EXPR_VARIABLE)) return alloc_leaf(allocator, expr_load(e));
+  return canonicalize_expr(e, allocator);
+}
+
+static void collect_chain_operands(expr_t *e, expr_tag_t variant, expr_t **operands, usize *len, allocator_t *allocator) {
+  if (expr_variant(e) != variant) {
+    operands[(*len)++] = canonicalize_child(e, allocator);
+    return;
+  }
+
+  collect_chain_operands(e->args.x, variant, operands, len, allocator);
+  collect_chain_operands(e->args.y, variant, operands, len, allocator);
+}
+
+static i32 expr_compare_indirect(const void *a, const void *b) {
+  return expr_compare(*(expr_t *const *)a, *(expr_t *const *)b);
+}
+
+// returns a freshly allocated canonical copy of `e` (free with free_expr()).
+// its leaves are inline wherever they fit
+expr_t *canonicalize_expr(expr_t *e, allocator_t *allocator) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT:
+    case EXPR_VARIABLE: return alloc_expr(allocator, expr_load(e));
+
+    case EXPR_PRODUCT:
+    case EXPR_SUM: {
+      usize len = 0;
+      expr_t **operands = (expr_t**)allocator->alloc(sizeof(expr_t*) * count_chain_operands(e, expr_variant(e)));
+
+      collect_chain_operands(e, expr_variant(e), operands, &len, allocator);
+      qsort(operands, len, sizeof(expr_t*), expr_compare_indirect);
+
+      expr_t *chain = operands[0];
+      for (usize i = 1; i < len; i++)
+        chain = alloc_expr(allocator, (expr_t){ .args = (binary_expr_t){ .x = chain, .y = operands[i] }, .variant = expr_variant(e) });
+
+      allocator->dealloc((u8*)operands);
+      return chain;
+    }
+
+    case EXPR_QUOTIENT:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: {
+      expr_t *x = canonicalize_child(e->args.x, allocator);
+      expr_t *y = canonicalize_child(e->args.y, allocator);
+      return alloc_expr(allocator, (expr_t){ .args = (binary_expr_t){ .x = x, .y = y }, .variant = expr_variant(e) });
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: {
+      expr_t *x = canonicalize_child(e->arg.x, allocator);
+      return alloc_expr(allocator, (expr_t){ .arg = (unary_expr_t){ x }, .variant = expr_variant(e) });
+    }
+
+    default:
+      puts("canonicalize_expr: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+static inline u64 fingerprint_mix(u64 h, u64 v) {
+  // splitmix64 finalizer over the running state
+  h ^= v + 0x9E3779B97F4A7C15ULL + (h << 6) + (h >> 2);
+  h ^= h >> 30;
+  h *= 0xBF58476D1CE4E5B9ULL;
+  h ^= h >> 27;
+  h *= 0x94D049BB133111EBULL;
+  return h ^ (h >> 31);
+}
+
+static void fingerprint_expr(expr_t *e, u64 *hi, u64 *lo) {
+  expr_tag_t variant = expr_variant(e);
+  u64 payload = 0;
+
+  if (variant == EXPR_CONSTANT) {
+    f64 constant = expr_constant(e);
+    memcpy(&payload, &constant, sizeof(u64));
+  } else if (variant == EXPR_VARIABLE) {
+    payload = (u64)(unsigned char)expr_variable(e);
+  }
+
+  *hi = fingerprint_mix(*hi, ((u64)variant << 48) ^ 0xA5A5);
+  *lo = fingerprint_mix(*lo, (u64)variant + 0x5A5A5A5A);
+  *hi = fingerprint_mix(*hi, payload);
+  *lo = fingerprint_mix(*lo, ~payload);
+
+  if ((variant == EXPR_CONSTANT) || (variant == EXPR_VARIABLE)) return;
+
+  if (is_binary_expression(e)) {
+    fingerprint_expr(e->args.x, hi, lo);
+    fingerprint_expr(e->args.y, hi, lo);
+  } else {
+    fingerprint_expr(e->arg.x, hi, lo);
+  }
+}
+
+// 128 bit structural hash; canonicalize_expr() first if x+y and y+x should match
+expr_fingerprint_t expr_fingerprint(expr_t *e) {
+  expr_fingerprint_t f = { .hi = 0x6C62272E07BB0142ULL, .lo = 0x62B821756295C58DULL };
+  fingerprint_expr(e, &f.hi, &f.lo);
+  return f;
+}
+
+#endif
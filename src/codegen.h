@@ -0,0 +1,410 @@
+#ifndef _LIBSEQ_CODEGEN_H
+#define _LIBSEQ_CODEGEN_H
+
+#include <stdbool.h>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+
+// ahead-of-time specialization: turns an expr_t into a standalone C
+// translation unit with a scalar function and an array loop over it.
+//
+// every distinct subtree is value numbered once and bound to a `const
+// double` temporary, so repeated subexpressions are only computed once, and
+// small integer powers are expanded into multiplications. the loop calls
+// the scalar function in the same TU so the compiler can inline and
+// vectorize it (build with `make generated`).
+
+#define CODEGEN_MAX_VARIABLES 64
+#define CODEGEN_MAX_EXPANDED_POWER 32
+
+typedef struct {
+  expr_tag_t variant;
+  u32 x, y;
+
+  union {
+    f64 constant;
+    char variable;
+  };
+
+  i32 temporary; // -1 for leaves, which are emitted inline
+} codegen_value_t;
+
+typedef struct {
+  codegen_value_t *values;
+  usize len, cap;
+
+  u32 *table; // value index + 1, 0 is empty
+  usize table_cap;
+
+  u32 num_temporaries;
+  FILE *out;
+  allocator_t *allocator;
+} codegen_t;
+
+static usize count_expr_nodes(expr_t *e) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT:
+    case EXPR_VARIABLE: { return 1; }
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: { return 1 + count_expr_nodes(e->args.x) + count_expr_nodes(e->args.y); }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: { return 1 + count_expr_nodes(e->arg.x); }
+
+    default:
+      puts("count_expr_nodes: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+static bool codegen_collect_variables(expr_t *e, char *variables, usize *num_variables) {
+  if (expr_variant(e) == EXPR_VARIABLE) {
+    if (!isalpha((unsigned char)expr_variable(e)) && (expr_variable(e) != '_')) return false;
+    if (memchr(variables, expr_variable(e), *num_variables)) return true;
+    if (*num_variables == CODEGEN_MAX_VARIABLES) return false;
+
+    variables[(*num_variables)++] = expr_variable(e);
+    return true;
+  }
+
+  if (expr_variant(e) == EXPR_CONSTANT) return true;
+
+  if (is_binary_expression(e))
+    return codegen_collect_variables(e->args.x, variables, num_variables) &&
+      codegen_collect_variables(e->args.y, variables, num_variables);
+
+  return codegen_collect_variables(e->arg.x, variables, num_variables);
+}
+
+static u64 codegen_value_hash(codegen_value_t *v) {
+  u64 bits = 0;
+  if (v->variant == EXPR_CONSTANT) memcpy(&bits, &v->constant, sizeof(bits));
+  else if (v->variant == EXPR_VARIABLE) bits = (u64)(unsigned char)v->variable;
+  else bits = ((u64)v->x << 32) | v->y;
+
+  u64 h = (bits ^ ((u64)v->variant << 56)) * 0x9E3779B97F4A7C15ULL;
+  return h ^ (h >> 29);
+}
+
+static bool codegen_value_equal(codegen_value_t *a, codegen_value_t *b) {
+  if (a->variant != b->variant) return false;
+  if (a->variant == EXPR_CONSTANT) return memcmp(&a->constant, &b->constant, sizeof(f64)) == 0;
+  if (a->variant == EXPR_VARIABLE) return a->variable == b->variable;
+  return (a->x == b->x) && (a->y == b->y);
+}
+
+static void codegen_operand(codegen_t *g, u32 id) {
+  codegen_value_t *v = &g->values[id];
+
+  if (v->temporary >= 0) fprintf(g->out, "t%d", v->temporary);
+  else if (v->variant == EXPR_VARIABLE) fprintf(g->out, "%c", v->variable);
+  else if (isnan(v->constant)) fprintf(g->out, "NAN");
+  else if (isinf(v->constant)) fprintf(g->out, (v->constant < 0.0) ? "(-INFINITY)" : "INFINITY");
+  else fprintf(g->out, "(%a)", v->constant); // hex floats round-trip exactly
+}
+
+static bool codegen_small_integer_exponent(codegen_t *g, u32 exponent, i64 *n) {
+  codegen_value_t *v = &g->values[exponent];
+  if (v->variant != EXPR_CONSTANT) return false;
+  if (v->constant != floor(v->constant)) return false;
+  if (fabs(v->constant) > CODEGEN_MAX_EXPANDED_POWER) return false;
+  if (v->constant == 0.0) return false; // pow(x, 0) is 1 even for nan x, leave it to libm
+
+  *n = (i64)v->constant;
+  return true;
+}
+
+static void codegen_emit(codegen_t *g, codegen_value_t *v) {
+  v->temporary = (i32)g->num_temporaries++;
+  fprintf(g->out, "  const double t%d = ", v->temporary);
+
+  switch (v->variant) {
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE: {
+      const char *op = (v->variant == EXPR_PRODUCT) ? " * "
+        : (v->variant == EXPR_QUOTIENT) ? " / "
+        : (v->variant == EXPR_SUM) ? " + "
+        : " - ";
+
+      codegen_operand(g, v->x);
+      fprintf(g->out, "%s", op);
+      codegen_operand(g, v->y);
+      break;
+    }
+
+    case EXPR_EXPONENTIAL:
+    case EXPR_POWER: {
+      fprintf(g->out, "pow(");
+      codegen_operand(g, v->x);
+      fprintf(g->out, ", ");
+      codegen_operand(g, v->y);
+      fprintf(g->out, ")");
+      break;
+    }
+
+    case EXPR_LOGARITHM: {
+      fprintf(g->out, "log(");
+      codegen_operand(g, v->y);
+      fprintf(g->out, ") / log(");
+      codegen_operand(g, v->x);
+      fprintf(g->out, ")");
+      break;
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN: {
+      fprintf(g->out, (v->variant == EXPR_SIN) ? "sin(" : (v->variant == EXPR_COS) ? "cos(" : "tan(");
+      codegen_operand(g, v->x);
+      fprintf(g->out, ")");
+      break;
+    }
+
+    case EXPR_NEGATION: {
+      fprintf(g->out, "-");
+      codegen_operand(g, v->x);
+      break;
+    }
+
+    case EXPR_INVERSE: {
+      fprintf(g->out, "1.0 / ");
+      codegen_operand(g, v->x);
+      break;
+    }
+
+    default:
+      puts("codegen_emit: corrupted/unhandled expression variant");
+      abort();
+  }
+
+  fprintf(g->out, ";\n");
+}
+
+static void codegen_grow(codegen_t *g) {
+  usize cap = g->cap * 2;
+  codegen_value_t *values = (codegen_value_t*)g->allocator->alloc(sizeof(codegen_value_t) * cap);
+  memcpy(values, g->values, sizeof(codegen_value_t) * g->len);
+  g->allocator->dealloc((u8*)g->values);
+  g->values = values;
+  g->cap = cap;
+
+  if (2 * cap <= g->table_cap) return;
+
+  g->allocator->dealloc((u8*)g->table);
+  g->table_cap *= 2;
+  g->table = (u32*)g->allocator->alloc(sizeof(u32) * g->table_cap);
+  memset(g->table, 0, sizeof(u32) * g->table_cap);
+
+  usize mask = g->table_cap - 1;
+  for (u32 id = 0; id < g->len; id++) {
+    usize slot = codegen_value_hash(&g->values[id]) & mask;
+    while (g->table[slot]) slot = (slot + 1) & mask;
+    g->table[slot] = id + 1;
+  }
+}
+
+// value number of `v`, emitting a temporary the first time it's seen
+static u32 codegen_intern(codegen_t *g, codegen_value_t v) {
+  if (g->len == g->cap) codegen_grow(g);
+
+  usize mask = g->table_cap - 1;
+  usize slot = codegen_value_hash(&v) & mask;
+
+  while (g->table[slot]) {
+    u32 id = g->table[slot] - 1;
+    if (codegen_value_equal(&g->values[id], &v)) return id;
+    slot = (slot + 1) & mask;
+  }
+
+  u32 id = (u32)g->len++;
+  g->values[id] = v;
+  g->table[slot] = id + 1;
+
+  if ((v.variant != EXPR_CONSTANT) && (v.variant != EXPR_VARIABLE)) codegen_emit(g, &g->values[id]);
+
+  return id;
+}
+
+static u32 codegen_product(codegen_t *g, u32 a, u32 b) {
+  // operands in a fixed order so x * x^2 and x^2 * x share a value
+  return codegen_intern(g, (codegen_value_t){ .variant = EXPR_PRODUCT, .x = (a < b) ? a : b, .y = (a < b) ? b : a, .temporary = -1 });
+}
+
+// binary exponentiation. the squares and partial products are ordinary
+// values, so x^3 and x^-2 share their x * x
+static u32 codegen_expand_power(codegen_t *g, u32 base, i64 n) {
+  bool negative = n < 0;
+  if (negative) n = -n;
+
+  u32 square = base;
+  u32 result = base;
+  bool have_result = false;
+
+  for (;;) {
+    if (n & 1) {
+      result = have_result ? codegen_product(g, result, square) : square;
+      have_result = true;
+    }
+
+    n >>= 1;
+    if (n == 0) break;
+
+    square = codegen_product(g, square, square);
+  }
+
+  if (negative) result = codegen_intern(g, (codegen_value_t){ .variant = EXPR_INVERSE, .x = result, .temporary = -1 });
+  return result;
+}
+
+// returns the value number of `e`, emitting a temporary the first time a
+// subtree is seen
+static u32 codegen_value(codegen_t *g, expr_t *e) {
+  codegen_value_t v = { .variant = expr_variant(e), .temporary = -1 };
+
+  if (expr_variant(e) == EXPR_CONSTANT) v.constant = expr_constant(e);
+  else if (expr_variant(e) == EXPR_VARIABLE) v.variable = expr_variable(e);
+  else if (is_binary_expression(e)) {
+    v.x = codegen_value(g, e->args.x);
+    v.y = codegen_value(g, e->args.y);
+
+    i64 n;
+    if (((v.variant == EXPR_POWER) || (v.variant == EXPR_EXPONENTIAL)) && codegen_small_integer_exponent(g, v.y, &n))
+      return codegen_expand_power(g, v.x, n);
+  } else {
+    v.x = codegen_value(g, e->arg.x);
+  }
+
+  return codegen_intern(g, v);
+}
+
+static bool codegen_valid_identifier(const char *name) {
+  if (!isalpha((unsigned char)name[0]) && (name[0] != '_')) return false;
+
+  for (const char *c = name + 1; *c; c++)
+    if (!isalnum((unsigned char)*c) && (*c != '_')) return false;
+
+  return true;
+}
+
+// names the generated file already uses: C keywords, what the generated code
+// calls or spells out from <math.h>/<stddef.h>, the batch function's own
+// parameters, and the common <math.h> functions a definition would clash with
+static const char *codegen_reserved_names[] = {
+  "auto", "bool", "break", "case", "char", "const", "continue", "default", "do", "double", "else", "enum",
+  "extern", "false", "float", "for", "goto", "if", "inline", "int", "long", "register", "restrict", "return",
+  "short", "signed", "sizeof", "static", "struct", "switch", "true", "typedef", "union", "unsigned", "void",
+  "volatile", "while",
+  "sin", "cos", "tan", "pow", "log", "NAN", "INFINITY", "size_t", "count", "out", "idx",
+  "asin", "acos", "atan", "atan2", "sinh", "cosh", "tanh", "exp", "exp2", "expm1", "log2", "log10", "log1p",
+  "sqrt", "cbrt", "hypot", "fabs", "floor", "ceil", "round", "trunc", "fmod", "fmin", "fmax",
+};
+
+// whether `name` would collide with something in the generated code: a
+// reserved name, a parameter or a CSE temporary (t0, t1, ...)
+static bool codegen_name_taken(const char *name, const char *variables, usize num_variables) {
+  for (usize i = 0; i < sizeof(codegen_reserved_names) / sizeof(codegen_reserved_names[0]); i++)
+    if (strcmp(name, codegen_reserved_names[i]) == 0) return true;
+
+  if ((name[0] != '\0') && (name[1] == '\0') && memchr(variables, name[0], num_variables)) return true;
+
+  if ((name[0] == 't') && (name[1] != '\0')) {
+    const char *c = name + 1;
+    while (isdigit((unsigned char)*c)) c++;
+    if (*c == '\0') return true;
+  }
+
+  return false;
+}
+
+// writes `double name(<variables>)` and
+// `void name_batch(size_t count, const double *<variables>, double *out)`.
+//
+// `variables` fixes the parameter order (NULL: order of first appearance).
+// fails without writing anything if `name` isn't a valid C identifier or
+// collides with a name the generated code uses (see codegen_name_taken()),
+// or if `e` uses a variable missing from `variables`, or if any variable
+// isn't a valid C identifier or shows up twice in `variables`.
+bool codegen_c(FILE *out, expr_t *e, const char *name, const char *variables, allocator_t *allocator) {
+  char found[CODEGEN_MAX_VARIABLES];
+  usize num_found = 0;
+
+  if (!codegen_valid_identifier(name)) return false;
+  if (!codegen_collect_variables(e, found, &num_found)) return false;
+
+  usize num_variables = num_found;
+  if (variables) {
+    num_variables = strlen(variables);
+    if (num_variables > CODEGEN_MAX_VARIABLES) return false;
+
+    for (usize i = 0; i < num_variables; i++) {
+      if (!isalpha((unsigned char)variables[i]) && (variables[i] != '_')) return false;
+      if (memchr(variables, variables[i], i)) return false;
+    }
+
+    for (usize i = 0; i < num_found; i++)
+      if (!memchr(variables, found[i], num_variables)) return false;
+  } else {
+    variables = found;
+  }
+
+  if (codegen_name_taken(name, variables, num_variables)) return false;
+
+  usize nodes = count_expr_nodes(e);
+  usize table_cap = 16;
+  while (table_cap < 2 * nodes) table_cap <<= 1;
+
+  codegen_t g = {
+    .values = (codegen_value_t*)allocator->alloc(sizeof(codegen_value_t) * nodes),
+    .cap = nodes,
+    .table = (u32*)allocator->alloc(sizeof(u32) * table_cap),
+    .table_cap = table_cap,
+    .out = out,
+    .allocator = allocator,
+  };
+  memset(g.table, 0, sizeof(u32) * table_cap);
+
+  fprintf(out, "#include <math.h>\n#include <stddef.h>\n\n");
+
+  fprintf(out, "double %s(", name);
+  if (num_variables == 0) fprintf(out, "void");
+  for (usize i = 0; i < num_variables; i++) fprintf(out, "%sdouble %c", (i > 0) ? ", " : "", variables[i]);
+  fprintf(out, ") {\n");
+
+  u32 root = codegen_value(&g, e);
+
+  fprintf(out, "  return ");
+  codegen_operand(&g, root);
+  fprintf(out, ";\n}\n\n");
+
+  fprintf(out, "void %s_batch(size_t count, ", name);
+  for (usize i = 0; i < num_variables; i++) fprintf(out, "const double *restrict %c, ", variables[i]);
+  fprintf(out, "double *restrict out) {\n");
+  fprintf(out, "  for (size_t idx = 0; idx < count; idx++)\n");
+  fprintf(out, "    out[idx] = %s(", name);
+  for (usize i = 0; i < num_variables; i++) fprintf(out, "%s%c[idx]", (i > 0) ? ", " : "", variables[i]);
+  fprintf(out, ");\n}\n");
+
+  allocator->dealloc((u8*)g.values);
+  allocator->dealloc((u8*)g.table);
+  return true;
+}
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef _LIBSEQ_DERIVATIVE_H
+#define _LIBSEQ_DERIVATIVE_H
+
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+
+// symbolic differentiation
+//
+// derivatives come out as trees owned entirely by the allocator (release
+// with free_expr()), with every reused subtree of the input copied, and
+// with the 0 and 1 factors the chain rule produces dropped on the spot so
+// the result doesn't balloon before simplify() ever sees it.
+
+expr_t *copy_expr(allocator_t *allocator, expr_t *e);
+
+static expr_t *copy_child(allocator_t *allocator, expr_t *e) {
+  expr_tag_t variant = expr_variant(e);
+  if ((variant == EXPR_CONSTANT) || (variant == EXPR_VARIABLE)) return alloc_leaf(allocator, expr_load(e));
+  return copy_expr(allocator, e);
+}
+
+// deep copy owned by `allocator`, leaves inline where they fit
+expr_t *copy_expr(allocator_t *allocator, expr_t *e) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT:
+    case EXPR_VARIABLE: return alloc_expr(allocator, expr_load(e));
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER:
+      return alloc_expr(allocator, BinaryNode(e->variant, copy_child(allocator, e->args.x), copy_child(allocator, e->args.y)));
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE:
+      return alloc_expr(allocator, UnaryNode(e->variant, copy_child(allocator, e->arg.x)));
+
+    default:
+      puts("copy_expr: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+static bool is_constant_value(expr_t *e, f64 value) {
+  return (expr_variant(e) == EXPR_CONSTANT) && (expr_constant(e) == value);
+}
+
+static expr_t *d_constant(allocator_t *allocator, f64 c) {
+  return alloc_expr(allocator, Const(c));
+}
+
+// the d_* builders take ownership of their operands, which (like their
+// results) are always nodes; leaves only go inline once they become children
+static expr_t *d_child(allocator_t *allocator, expr_t *x) {
+  expr_tag_t variant = expr_variant(x);
+  if ((variant != EXPR_CONSTANT) && (variant != EXPR_VARIABLE)) return x;
+
+  expr_t *slot = alloc_leaf(allocator, *x);
+  allocator->dealloc((u8*)x);
+  return slot;
+}
+
+static expr_t *d_binary(allocator_t *allocator, expr_tag_t variant, expr_t *x, expr_t *y) {
+  if ((expr_variant(x) == EXPR_CONSTANT) && (expr_variant(y) == EXPR_CONSTANT)) {
+    f64 folded = fold_constants(variant, expr_constant(x), expr_constant(y));
+    free_expr(allocator, x);
+    free_expr(allocator, y);
+    return d_constant(allocator, folded);
+  }
+
+  return alloc_expr(allocator, BinaryNode(variant, d_child(allocator, x), d_child(allocator, y)));
+}
+
+static expr_t *d_sum(allocator_t *allocator, expr_t *x, expr_t *y) {
+  if (is_constant_value(x, 0.0)) { free_expr(allocator, x); return y; }
+  if (is_constant_value(y, 0.0)) { free_expr(allocator, y); return x; }
+  return d_binary(allocator, EXPR_SUM, x, y);
+}
+
+static expr_t *d_negation(allocator_t *allocator, expr_t *x) {
+  if (expr_variant(x) == EXPR_CONSTANT) {
+    f64 c = expr_constant(x);
+    free_expr(allocator, x);
+    return d_constant(allocator, -c);
+  }
+
+  if (expr_variant(x) == EXPR_NEGATION) {
+    expr_t *inner = x->arg.x;
+    allocator->dealloc((u8*)x);
+    return expr_is_inline(inner) ? alloc_expr(allocator, expr_load(inner)) : inner;
+  }
+
+  return alloc_expr(allocator, UnaryNode(EXPR_NEGATION, d_child(allocator, x)));
+}
+
+static expr_t *d_difference(allocator_t *allocator, expr_t *x, expr_t *y) {
+  if (is_constant_value(y, 0.0)) { free_expr(allocator, y); return x; }
+  if (is_constant_value(x, 0.0)) { free_expr(allocator, x); return d_negation(allocator, y); }
+  return d_binary(allocator, EXPR_DIFFERENCE, x, y);
+}
+
+static expr_t *d_product(allocator_t *allocator, expr_t *x, expr_t *y) {
+  if (is_constant_value(x, 0.0) || is_constant_value(y, 0.0)) {
+    free_expr(allocator, x);
+    free_expr(allocator, y);
+    return d_constant(allocator, 0.0);
+  }
+
+  if (is_constant_value(x, 1.0)) { free_expr(allocator, x); return y; }
+  if (is_constant_value(y, 1.0)) { free_expr(allocator, y); return x; }
+  if (is_constant_value(x, -1.0)) { free_expr(allocator, x); return d_negation(allocator, y); }
+  if (is_constant_value(y, -1.0)) { free_expr(allocator, y); return d_negation(allocator, x); }
+
+  return d_binary(allocator, EXPR_PRODUCT, x, y);
+}
+
+static expr_t *d_quotient(allocator_t *allocator, expr_t *x, expr_t *y) {
+  if (is_constant_value(x, 0.0)) { free_expr(allocator, y); return x; }
+  if (is_constant_value(y, 1.0)) { free_expr(allocator, y); return x; }
+  return d_binary(allocator, EXPR_QUOTIENT, x, y);
+}
+
+static expr_t *d_unary(allocator_t *allocator, expr_tag_t variant, expr_t *x) {
+  if (expr_variant(x) == EXPR_CONSTANT) {
+    f64 folded = fold_constants(variant, expr_constant(x), 0.0);
+    free_expr(allocator, x);
+    return d_constant(allocator, folded);
+  }
+
+  return alloc_expr(allocator, UnaryNode(variant, d_child(allocator, x)));
+}
+
+static expr_t *d_power(allocator_t *allocator, expr_t *x, expr_t *y) {
+  if (is_constant_value(y, 1.0)) { free_expr(allocator, y); return x; }
+  if (is_constant_value(y, 0.0)) { free_expr(allocator, x); free_expr(allocator, y); return d_constant(allocator, 1.0); }
+  return d_binary(allocator, EXPR_POWER, x, y);
+}
+
+// ln(x), as the repo's log(base, x)
+static expr_t *d_ln(allocator_t *allocator, expr_t *x) {
+  return d_binary(allocator, EXPR_LOGARITHM, d_constant(allocator, M_E), x);
+}
+
+static bool depends_on(expr_t *e, char variable) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT: return false;
+    case EXPR_VARIABLE: return expr_variable(e) == variable;
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: return depends_on(e->args.x, variable) || depends_on(e->args.y, variable);
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: return depends_on(e->arg.x, variable);
+
+    default:
+      puts("depends_on: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+// d/d`variable` of `e`. `e` isn't modified and shares nothing with the result
+expr_t *differentiate(expr_t *e, char variable, allocator_t *allocator) {
+  allocator_t *a = allocator;
+
+  if (!depends_on(e, variable)) return d_constant(a, 0.0);
+
+  switch (expr_variant(e)) {
+    case EXPR_VARIABLE: return d_constant(a, 1.0);
+
+    case EXPR_SUM: return d_sum(a, differentiate(e->args.x, variable, a), differentiate(e->args.y, variable, a));
+    case EXPR_DIFFERENCE: return d_difference(a, differentiate(e->args.x, variable, a), differentiate(e->args.y, variable, a));
+
+    case EXPR_PRODUCT: {
+      // f'g + fg'
+      expr_t *f = e->args.x, *g = e->args.y;
+      return d_sum(a,
+        d_product(a, differentiate(f, variable, a), copy_expr(a, g)),
+        d_product(a, copy_expr(a, f), differentiate(g, variable, a)));
+    }
+
+    case EXPR_QUOTIENT: {
+      // (f'g - fg') / (g*g)
+      expr_t *f = e->args.x, *g = e->args.y;
+      expr_t *numerator = d_difference(a,
+        d_product(a, differentiate(f, variable, a), copy_expr(a, g)),
+        d_product(a, copy_expr(a, f), differentiate(g, variable, a)));
+      return d_quotient(a, numerator, d_product(a, copy_expr(a, g), copy_expr(a, g)));
+    }
+
+    case EXPR_EXPONENTIAL:
+    case EXPR_POWER: {
+      expr_t *f = e->args.x, *g = e->args.y;
+
+      // f^c: c f^(c-1) f'
+      if (!depends_on(g, variable)) {
+        expr_t *lowered = d_power(a, copy_expr(a, f), d_difference(a, copy_expr(a, g), d_constant(a, 1.0)));
+        return d_product(a, d_product(a, copy_expr(a, g), lowered), differentiate(f, variable, a));
+      }
+
+      // c^g: c^g ln(c) g'
+      if (!depends_on(f, variable)) {
+        return d_product(a, d_product(a, copy_expr(a, e), d_ln(a, copy_expr(a, f))), differentiate(g, variable, a));
+      }
+
+      // f^g (g' ln(f) + g f'/f)
+      expr_t *inner = d_sum(a,
+        d_product(a, differentiate(g, variable, a), d_ln(a, copy_expr(a, f))),
+        d_quotient(a, d_product(a, copy_expr(a, g), differentiate(f, variable, a)), copy_expr(a, f)));
+      return d_product(a, copy_expr(a, e), inner);
+    }
+
+    case EXPR_LOGARITHM: {
+      expr_t *base = e->args.x, *f = e->args.y;
+
+      // log_c(f): f' / (f ln(c))
+      if (!depends_on(base, variable)) {
+        return d_quotient(a, differentiate(f, variable, a), d_product(a, copy_expr(a, f), d_ln(a, copy_expr(a, base))));
+      }
+
+      // ln(f)/ln(b): (f'/f ln(b) - ln(f) b'/b) / ln(b)^2
+      expr_t *numerator = d_difference(a,
+        d_product(a, d_quotient(a, differentiate(f, variable, a), copy_expr(a, f)), d_ln(a, copy_expr(a, base))),
+        d_product(a, d_ln(a, copy_expr(a, f)), d_quotient(a, differentiate(base, variable, a), copy_expr(a, base))));
+      return d_quotient(a, numerator, d_product(a, d_ln(a, copy_expr(a, base)), d_ln(a, copy_expr(a, base))));
+    }
+
+    case EXPR_SIN: return d_product(a, d_unary(a, EXPR_COS, copy_expr(a, e->arg.x)), differentiate(e->arg.x, variable, a));
+
+    case EXPR_COS: return d_product(a, d_negation(a, d_unary(a, EXPR_SIN, copy_expr(a, e->arg.x))), differentiate(e->arg.x, variable, a));
+
+    case EXPR_TAN: {
+      // f' / (cos(f) cos(f))
+      expr_t *cos_f = d_unary(a, EXPR_COS, copy_expr(a, e->arg.x));
+      expr_t *cos_f2 = d_unary(a, EXPR_COS, copy_expr(a, e->arg.x));
+      return d_quotient(a, differentiate(e->arg.x, variable, a), d_product(a, cos_f, cos_f2));
+    }
+
+    case EXPR_NEGATION: return d_negation(a, differentiate(e->arg.x, variable, a));
+
+    case EXPR_INVERSE: {
+      // -f' / (f*f)
+      expr_t *f = e->arg.x;
+      return d_negation(a, d_quotient(a, differentiate(f, variable, a), d_product(a, copy_expr(a, f), copy_expr(a, f))));
+    }
+
+    default:
+      puts("differentiate: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+#endif
@@ -0,0 +1,195 @@
+#ifndef _LIBSEQ_EVALUATE_H
+#define _LIBSEQ_EVALUATE_H
+
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+#include "fastmath.h"
+
+// numeric evaluation of expression trees
+//
+// variables are bound positionally: `variables` is a string of variable
+// names and values[i] is the value (or, for batches, the array of values)
+// of variables[i].
+//
+// the batched evaluator walks the tree once per chunk of EVALUATE_CHUNK
+// points instead of once per point, so every node is a tight loop over a
+// chunk and the transcendental nodes go through the fastmath kernels at
+// the requested accuracy.
+
+#define EVALUATE_CHUNK 256
+
+static usize evaluate_variable_index(const char *variables, char variable) {
+  const char *at = variables ? strchr(variables, variable) : NULL;
+
+  if (!at || (variable == '\0')) {
+    printf("evaluate: unbound variable '%c'\n", variable);
+    abort();
+  }
+
+  return (usize)(at - variables);
+}
+
+f64 evaluate(expr_t *e, const char *variables, const f64 *values) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT: return expr_constant(e);
+    case EXPR_VARIABLE: return values[evaluate_variable_index(variables, expr_variable(e))];
+
+    case EXPR_PRODUCT: return evaluate(e->args.x, variables, values) * evaluate(e->args.y, variables, values);
+    case EXPR_QUOTIENT: return evaluate(e->args.x, variables, values) / evaluate(e->args.y, variables, values);
+    case EXPR_SUM: return evaluate(e->args.x, variables, values) + evaluate(e->args.y, variables, values);
+    case EXPR_DIFFERENCE: return evaluate(e->args.x, variables, values) - evaluate(e->args.y, variables, values);
+
+    case EXPR_EXPONENTIAL:
+    case EXPR_POWER: return pow(evaluate(e->args.x, variables, values), evaluate(e->args.y, variables, values));
+
+    case EXPR_LOGARITHM: return log(evaluate(e->args.y, variables, values)) / log(evaluate(e->args.x, variables, values));
+
+    case EXPR_SIN: return sin(evaluate(e->arg.x, variables, values));
+    case EXPR_COS: return cos(evaluate(e->arg.x, variables, values));
+    case EXPR_TAN: return tan(evaluate(e->arg.x, variables, values));
+
+    case EXPR_NEGATION: return -evaluate(e->arg.x, variables, values);
+    case EXPR_INVERSE: return (f64)1.0 / evaluate(e->arg.x, variables, values);
+
+    default:
+      puts("evaluate: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+usize expr_height(expr_t *e) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT:
+    case EXPR_VARIABLE: return 1;
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: {
+      usize x = expr_height(e->args.x);
+      usize y = expr_height(e->args.y);
+      return 1 + ((x > y) ? x : y);
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: return 1 + expr_height(e->arg.x);
+
+    default:
+      puts("expr_height: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+typedef struct {
+  const char *variables;
+  const f64 *const *values;
+  usize offset; // index of the chunk's first point
+  fastmath_accuracy_t accuracy;
+
+  f64 *scratch; // one EVALUATE_CHUNK buffer per tree level
+} evaluate_batch_t;
+
+// evaluates `e` for points [offset, offset + len) into dst, using scratch
+// buffers from `level` down
+static void evaluate_chunk(evaluate_batch_t *b, expr_t *e, f64 *dst, usize len, usize level) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT: {
+      for (usize i = 0; i < len; i++) dst[i] = expr_constant(e);
+      return;
+    }
+
+    case EXPR_VARIABLE: {
+      const f64 *src = b->values[evaluate_variable_index(b->variables, expr_variable(e))] + b->offset;
+      memcpy(dst, src, sizeof(f64) * len);
+      return;
+    }
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: {
+      f64 *y = b->scratch + level * EVALUATE_CHUNK;
+
+      evaluate_chunk(b, e->args.x, dst, len, level + 1);
+      evaluate_chunk(b, e->args.y, y, len, level + 1);
+
+      switch (expr_variant(e)) {
+        case EXPR_PRODUCT: for (usize i = 0; i < len; i++) dst[i] *= y[i]; break;
+        case EXPR_QUOTIENT: for (usize i = 0; i < len; i++) dst[i] /= y[i]; break;
+        case EXPR_SUM: for (usize i = 0; i < len; i++) dst[i] += y[i]; break;
+        case EXPR_DIFFERENCE: for (usize i = 0; i < len; i++) dst[i] -= y[i]; break;
+
+        case EXPR_EXPONENTIAL:
+        case EXPR_POWER: fastmath_pow_f64(dst, dst, y, len, b->accuracy); break;
+
+        case EXPR_LOGARITHM: {
+          fastmath_log_f64(dst, dst, len, b->accuracy);
+          fastmath_log_f64(y, y, len, b->accuracy);
+          for (usize i = 0; i < len; i++) dst[i] = y[i] / dst[i];
+          break;
+        }
+
+        default: break;
+      }
+      return;
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: {
+      evaluate_chunk(b, e->arg.x, dst, len, level + 1);
+
+      switch (expr_variant(e)) {
+        case EXPR_SIN: fastmath_sin_f64(dst, dst, len, b->accuracy); break;
+        case EXPR_COS: fastmath_cos_f64(dst, dst, len, b->accuracy); break;
+        case EXPR_TAN: fastmath_tan_f64(dst, dst, len, b->accuracy); break;
+        case EXPR_NEGATION: for (usize i = 0; i < len; i++) dst[i] = -dst[i]; break;
+        case EXPR_INVERSE: for (usize i = 0; i < len; i++) dst[i] = (f64)1.0 / dst[i]; break;
+        default: break;
+      }
+      return;
+    }
+
+    default:
+      puts("evaluate_batch: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+// out[i] = e evaluated at (values[0][i], values[1][i], ...) for i < n
+void evaluate_batch(f64 *out, expr_t *e, const char *variables, const f64 *const *values, usize n,
+                    fastmath_accuracy_t accuracy, allocator_t *allocator) {
+  evaluate_batch_t b = {
+    .variables = variables,
+    .values = values,
+    .accuracy = accuracy,
+    .scratch = (f64*)allocator->alloc(sizeof(f64) * EVALUATE_CHUNK * expr_height(e)),
+  };
+
+  for (b.offset = 0; b.offset < n; b.offset += EVALUATE_CHUNK) {
+    usize len = (n - b.offset < EVALUATE_CHUNK) ? n - b.offset : EVALUATE_CHUNK;
+    evaluate_chunk(&b, e, out + b.offset, len, 0);
+  }
+
+  allocator->dealloc((u8*)b.scratch);
+}
+
+#endif
@@ -9,6 +9,7 @@
 #include <string.h>
 
 #include "primitives.h"
+#include "allocator.h"
 
 struct __expr_t;
 
@@ -53,26 +54,160 @@ typedef struct __expr_t expr_t;
 #define Const(c) (expr_t) { .constant = (f64)c, .variant = EXPR_CONSTANT }
 #define Var(c) (expr_t) { .variable = (char)c, .variant = EXPR_VARIABLE }
 
-#define Product(a, b) (expr_t) { .args = (binary_expr_t){ .x = (a), .y = (b) }, .variant = EXPR_PRODUCT }
-#define Quotient(a, b) (expr_t) { .args = (binary_expr_t){ .x = (a), .y = (b) }, .variant = EXPR_QUOTIENT }
+// raw constructors, no folding (see below). plain braces rather than
+// nested compound literals keep them constant expressions, so they also
+// work in file scope initializers
+#define BinaryNode(tag, a, b) (expr_t) { .args = { .x = (a), .y = (b) }, .variant = (tag) }
+#define UnaryNode(tag, e) (expr_t) { .arg = { .x = (e) }, .variant = (tag) }
+
+// the operator constructors fold as they build: an operator whose operands
+// are all constants comes out as a single constant node. the folding
+// helpers are always_inline and the operands are compound literals the
+// compiler can see into, so a tree written out of Const() and these macros
+// is folded at compile time when optimizing (-O1 and up, checked by
+// test/main.c) rather than by simplify() on every run. unoptimized builds
+// (the plain -g test build) fold the same way, just when the tree is
+// built. a mixed tree keeps its constant subtrees folded.
+//
+// each one is a one element compound literal array around the call, so
+// &Sum(...) still takes the address of a node living in the enclosing
+// block. that call makes them not constant expressions any more: file
+// scope initializers written with Sum()/Product()/... no longer compile
+// and have to spell the nodes with BinaryNode()/UnaryNode(). so do trees
+// whose children are owned by an allocator (folding would leak them).
+#define Product(a, b) (expr_t[1]){ expr_fold_binary(EXPR_PRODUCT, (a), (b)) }[0]
+#define Quotient(a, b) (expr_t[1]){ expr_fold_binary(EXPR_QUOTIENT, (a), (b)) }[0]
+
+#define Sum(a, b) (expr_t[1]){ expr_fold_binary(EXPR_SUM, (a), (b)) }[0]
+#define Difference(a, b) (expr_t[1]){ expr_fold_binary(EXPR_DIFFERENCE, (a), (b)) }[0]
+
+#define Exponential(a, b) (expr_t[1]){ expr_fold_binary(EXPR_EXPONENTIAL, (a), (b)) }[0]
+#define Logarithm(base, e) (expr_t[1]){ expr_fold_binary(EXPR_LOGARITHM, (base), (e)) }[0]
+#define Power(a, b) (expr_t[1]){ expr_fold_binary(EXPR_POWER, (a), (b)) }[0]
+
+#define Sin(e) (expr_t[1]){ expr_fold_unary(EXPR_SIN, (e)) }[0]
+#define Cos(e) (expr_t[1]){ expr_fold_unary(EXPR_COS, (e)) }[0]
+#define Tan(e) (expr_t[1]){ expr_fold_unary(EXPR_TAN, (e)) }[0]
+
+#define Negation(e) (expr_t[1]){ expr_fold_unary(EXPR_NEGATION, (e)) }[0]
+#define Inverse(e) (expr_t[1]){ expr_fold_unary(EXPR_INVERSE, (e)) }[0]
+
+// inline leaves: a child slot with the top pointer bit set holds its leaf
+// directly instead of pointing at a node. bit 62 picks a constant (stored
+// as an f32 in the low 32 bits, so only constants that round-trip through
+// f32 qualify) or a variable (low 8 bits). this needs user space pointers
+// to leave the top bit clear, which holds on x86-64 and linux/macOS arm64
+// but not on Android arm64 with heap pointer tagging (scudo puts 0xB4 in
+// the top byte): there the app has to set
+// android:allowNativeHeapPointerTagging="false". alloc_expr() aborts on a
+// pointer it would mistake for a leaf rather than corrupt the tree.
+//
+// only child slots are ever tagged, roots are always real nodes. read
+// leaves through expr_variant()/expr_constant()/expr_variable(), never
+// through the pointer.
+
+_Static_assert(sizeof(uintptr_t) == 8, "inline leaves need 64 bit pointers");
+
+#define EXPR_INLINE_BIT ((uintptr_t)1 << 63)
+#define EXPR_INLINE_CONSTANT_BIT ((uintptr_t)1 << 62)
+
+static inline bool expr_is_inline(const expr_t *e) {
+  return ((uintptr_t)e & EXPR_INLINE_BIT) != 0;
+}
+
+static inline expr_tag_t expr_variant(const expr_t *e) {
+  if (!expr_is_inline(e)) return e->variant;
+  return ((uintptr_t)e & EXPR_INLINE_CONSTANT_BIT) ? EXPR_CONSTANT : EXPR_VARIABLE;
+}
+
+static inline f64 expr_constant(const expr_t *e) {
+  if (!expr_is_inline(e)) return e->constant;
+
+  u32 bits = (u32)(uintptr_t)e;
+  f32 c;
+  memcpy(&c, &bits, sizeof(c));
+  return (f64)c;
+}
+
+static inline char expr_variable(const expr_t *e) {
+  if (!expr_is_inline(e)) return e->variable;
+  return (char)(u8)(uintptr_t)e;
+}
 
-#define Sum(a, b) (expr_t) { .args = (binary_expr_t){ .x = (a), .y = (b) }, .variant = EXPR_SUM }
-#define Difference(a, b) (expr_t) { .args = (binary_expr_t){ .x = (a), .y = (b) }, .variant = EXPR_DIFFERENCE }
+static inline bool expr_constant_fits_inline(f64 c) {
+  f64 narrowed = (f64)(f32)c;
+  return memcmp(&narrowed, &c, sizeof(f64)) == 0;
+}
+
+// c must satisfy expr_constant_fits_inline()
+static inline expr_t *expr_inline_constant(f64 c) {
+  f32 narrowed = (f32)c;
+  u32 bits;
+  memcpy(&bits, &narrowed, sizeof(bits));
+  return (expr_t*)(EXPR_INLINE_BIT | EXPR_INLINE_CONSTANT_BIT | (uintptr_t)bits);
+}
 
-#define Exponential(a, b) (expr_t) { .args = (binary_expr_t){ .x = (a), .y = (b) }, .variant = EXPR_EXPONENTIAL }
-#define Logarithm(base, e) (expr_t) { .args = (binary_expr_t){ .x = (base), .y = (e) }, .variant = EXPR_LOGARITHM }
-#define Power(a, b) (expr_t) { .args = (binary_expr_t){ .x = (a), .y = (b) }, .variant = EXPR_POWER }
+static inline expr_t *expr_inline_variable(char c) {
+  return (expr_t*)(EXPR_INLINE_BIT | (uintptr_t)(u8)c);
+}
 
-#define Sin(e) (expr_t) { .arg = (unary_expr_t){e}, .variant = EXPR_SIN }
-#define Cos(e) (expr_t) { .arg = (unary_expr_t){e}, .variant = EXPR_COS }
-#define Tan(e) (expr_t) { .arg = (unary_expr_t){e}, .variant = EXPR_TAN }
+// the leaf (or node) a slot refers to, as a node value
+static inline expr_t expr_load(const expr_t *e) {
+  if (!expr_is_inline(e)) return *e;
+  if (expr_variant(e) == EXPR_CONSTANT) return Const(expr_constant(e));
+  return Var(expr_variable(e));
+}
 
-#define Negation(e) (expr_t) { .arg = (unary_expr_t){e}, .variant = EXPR_NEGATION }
-#define Inverse(e) (expr_t) { .arg = (unary_expr_t){e}, .variant = EXPR_INVERSE }
+// leaves for child slots, e.g. Sum(VarLeaf('x'), ConstLeaf(2)). a constant
+// that doesn't fit inline falls back to a compound literal node
+#define VarLeaf(c) expr_inline_variable((char)(c))
+#define ConstLeaf(c) (expr_constant_fits_inline((f64)(c)) ? expr_inline_constant((f64)(c)) : &Const(c))
+
+[[gnu::always_inline]] static inline f64 fold_constants(expr_tag_t variant, f64 x, f64 y) {
+  switch (variant) {
+    case EXPR_PRODUCT: return x * y;
+    case EXPR_QUOTIENT: return x / y;
+    case EXPR_SUM: return x + y;
+    case EXPR_DIFFERENCE: return x - y;
+    case EXPR_EXPONENTIAL:
+    case EXPR_POWER: return pow(x, y);
+    case EXPR_LOGARITHM: return log(y) / log(x);
+    case EXPR_SIN: return sin(x);
+    case EXPR_COS: return cos(x);
+    case EXPR_TAN: return tan(x);
+    case EXPR_NEGATION: return -x;
+    case EXPR_INVERSE: return (f64)1.0 / x;
+
+    default:
+      puts("fold_constants: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+// the compiler can't rule out the inline tag bit on an address, so going
+// through expr_variant() alone would keep the folding at runtime. when
+// __builtin_constant_p says a node's variant is known (its operand is
+// never evaluated, and it can only be known for a real node the compiler
+// sees into) the fields are read directly instead
+#define expr_fold_is_constant(e) \
+  (__builtin_constant_p((e)->variant) ? ((e)->variant == EXPR_CONSTANT) : (expr_variant(e) == EXPR_CONSTANT))
+#define expr_fold_value(e) (__builtin_constant_p((e)->variant) ? (e)->constant : expr_constant(e))
+
+[[gnu::always_inline]] static inline expr_t expr_fold_binary(expr_tag_t variant, expr_t *x, expr_t *y) {
+  if (expr_fold_is_constant(x) && expr_fold_is_constant(y))
+    return Const(fold_constants(variant, expr_fold_value(x), expr_fold_value(y)));
+
+  return BinaryNode(variant, x, y);
+}
+
+[[gnu::always_inline]] static inline expr_t expr_fold_unary(expr_tag_t variant, expr_t *x) {
+  if (expr_fold_is_constant(x)) return Const(fold_constants(variant, expr_fold_value(x), 0.0));
+  return UnaryNode(variant, x);
+}
 
 
 static usize count_serialized_expr_size(expr_t *e, usize depth) {
-  expr_tag_t variant = e->variant;
+  expr_tag_t variant = expr_variant(e);
   bool parens_condition = (depth > 0) &&
     (variant != EXPR_CONSTANT) &&
     (variant != EXPR_VARIABLE) &&
@@ -88,7 +223,7 @@ static usize count_serialized_expr_size(expr_t *e, usize depth) {
 
   switch (variant) {
     case EXPR_CONSTANT: {
-      offset_written += snprintf(NULL, 0, "%.3g", e->constant);
+      offset_written += snprintf(NULL, 0, "%.3g", expr_constant(e));
       break;
     }
     case EXPR_VARIABLE: {
@@ -96,8 +231,8 @@ static usize count_serialized_expr_size(expr_t *e, usize depth) {
       break;
     }
     case EXPR_PRODUCT: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
 
       if (((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_VARIABLE)) || (x_variant == EXPR_SUM)) {
         // 
@@ -167,7 +302,7 @@ static usize count_serialized_expr_size(expr_t *e, usize depth) {
 }
 
 static usize counted_serialize_expr(char *serialization_buffer, expr_t *e, usize depth) {
-  expr_tag_t variant = e->variant;
+  expr_tag_t variant = expr_variant(e);
   bool parens_condition = (depth > 0) &&
     (variant != EXPR_CONSTANT) &&
     (variant != EXPR_VARIABLE) &&
@@ -185,20 +320,20 @@ static usize counted_serialize_expr(char *serialization_buffer, expr_t *e, usize
     case EXPR_CONSTANT: {
       i32 num_of_digits;
 
-      num_of_digits = snprintf(NULL, 0, "%.3g", e->constant);
-      sprintf(serialization_buffer + offset_written, "%.3g", e->constant);
+      num_of_digits = snprintf(NULL, 0, "%.3g", expr_constant(e));
+      sprintf(serialization_buffer + offset_written, "%.3g", expr_constant(e));
 
       offset_written += num_of_digits;
       break;
     }
     case EXPR_VARIABLE: {
-      sprintf (serialization_buffer + offset_written, "%c", e->variable);
+      sprintf (serialization_buffer + offset_written, "%c", expr_variable(e));
       offset_written++;
       break;
     }
     case EXPR_PRODUCT: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
 
       if (((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_VARIABLE)) || (x_variant == EXPR_SUM)) {
         offset_written += counted_serialize_expr(serialization_buffer + offset_written, e->args.x, depth + 1);
@@ -319,7 +454,7 @@ usize serialize_expr(char *buffer, expr_t *e) {
 }
 
 bool is_binary_expression(expr_t *e) {
-  switch (e->variant) {
+  switch (expr_variant(e)) {
     case EXPR_CONSTANT:
     case EXPR_VARIABLE:
     case EXPR_NEGATION:
@@ -343,7 +478,7 @@ bool is_binary_expression(expr_t *e) {
 }
 
 bool is_simplifiable(expr_t *e) {
-  switch (e->variant) {
+  switch (expr_variant(e)) {
     case EXPR_CONSTANT:
     case EXPR_VARIABLE: { return false; }
 
@@ -354,15 +489,15 @@ bool is_simplifiable(expr_t *e) {
     case EXPR_POWER:
     case EXPR_LOGARITHM:
     case EXPR_EXPONENTIAL: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
 
       if ((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_CONSTANT)) return true;
       else return is_simplifiable(e->args.x) || is_simplifiable(e->args.y);
     }
 
     case EXPR_NEGATION: {
-      if (e->arg.x->variant == EXPR_CONSTANT) return false;
+      if (expr_variant(e->arg.x) == EXPR_CONSTANT) return false;
       else return is_simplifiable(e->arg.x);
     }
 
@@ -370,7 +505,7 @@ bool is_simplifiable(expr_t *e) {
     case EXPR_COS:
     case EXPR_TAN:
     case EXPR_INVERSE: {
-      if (e->arg.x->variant == EXPR_CONSTANT) return true;
+      if (expr_variant(e->arg.x) == EXPR_CONSTANT) return true;
       else return is_simplifiable(e->arg.x);
     }
 
@@ -381,25 +516,25 @@ bool is_simplifiable(expr_t *e) {
 }
 
 void simplify(expr_t *e) {
-  switch (e->variant) {
+  switch (expr_variant(e)) {
     case EXPR_CONSTANT:
     case EXPR_VARIABLE: break;
 
     case EXPR_PRODUCT: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
       expr_t *x = e->args.x;
       expr_t *y = e->args.y;
 
       if ((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_CONSTANT)) {
-        *e = Const(x->constant * y->constant);
+        *e = Const(expr_constant(x) * expr_constant(y));
         break;
       }
 
       simplify(x);
       simplify(y);
 
-      expr_t product = Product(x, y);
+      expr_t product = BinaryNode(EXPR_PRODUCT, x, y);
       
       if (is_simplifiable(&product)) simplify(&product);
 
@@ -408,20 +543,20 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_QUOTIENT: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
       expr_t *x = e->args.x;
       expr_t *y = e->args.y;
 
       if ((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_CONSTANT)) {
-        *e = Const(x->constant / y->constant);
+        *e = Const(expr_constant(x) / expr_constant(y));
         break;
       }
 
       simplify(x);
       simplify(y);
 
-      expr_t quotient = Quotient(x, y);
+      expr_t quotient = BinaryNode(EXPR_QUOTIENT, x, y);
 
       if (is_simplifiable(&quotient)) simplify(&quotient);
 
@@ -430,20 +565,20 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_SUM: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
       expr_t *x = e->args.x;
       expr_t *y = e->args.y;
 
       if ((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_CONSTANT)) {
-        *e = Const(x->constant + y->constant);
+        *e = Const(expr_constant(x) + expr_constant(y));
         break;
       }
 
       simplify(x);
       simplify(y);
 
-      expr_t sum = Sum(x, y);
+      expr_t sum = BinaryNode(EXPR_SUM, x, y);
       if (is_simplifiable(&sum)) simplify(&sum);
 
       *e = sum;
@@ -451,20 +586,20 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_DIFFERENCE: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
       expr_t *x = e->args.x;
       expr_t *y = e->args.y;
 
       if ((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_CONSTANT)) {
-        *e = Const(x->constant - y->constant);
+        *e = Const(expr_constant(x) - expr_constant(y));
         break;
       }
 
       simplify(x);
       simplify(y);
 
-      expr_t difference = Difference(x, y);
+      expr_t difference = BinaryNode(EXPR_DIFFERENCE, x, y);
       if (is_simplifiable(&difference)) simplify(&difference);
 
       *e = difference;
@@ -472,20 +607,20 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_EXPONENTIAL: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
       expr_t *x = e->args.x;
       expr_t *y = e->args.y;
 
       if ((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_CONSTANT)) {
-        *e = Const(pow(x->constant, y->constant));
+        *e = Const(pow(expr_constant(x), expr_constant(y)));
         break;
       }
 
       simplify(x);
       simplify(y);
 
-      expr_t exponential = Exponential(x, y);
+      expr_t exponential = BinaryNode(EXPR_EXPONENTIAL, x, y);
       if (is_simplifiable(&exponential)) simplify(&exponential);
 
       *e = exponential;
@@ -493,20 +628,20 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_LOGARITHM: {
-      expr_tag_t base_variant = e->args.x->variant;
-      expr_tag_t expr_variant = e->args.y->variant;
+      expr_tag_t base_variant = expr_variant(e->args.x);
+      expr_tag_t argument_variant = expr_variant(e->args.y);
       expr_t *base = e->args.x;
       expr_t *expr = e->args.y;
 
-      if ((base_variant == EXPR_CONSTANT) && (expr_variant == EXPR_CONSTANT)) {
-        *e = Const(log(expr->constant) / log(base->constant));
+      if ((base_variant == EXPR_CONSTANT) && (argument_variant == EXPR_CONSTANT)) {
+        *e = Const(log(expr_constant(expr)) / log(expr_constant(base)));
         break;
       }
 
       simplify(base);
       simplify(expr);
 
-      expr_t logarithm = Logarithm(base, expr);
+      expr_t logarithm = BinaryNode(EXPR_LOGARITHM, base, expr);
       if (is_simplifiable(&logarithm)) simplify(&logarithm);
 
       *e = logarithm;
@@ -514,20 +649,20 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_POWER: {
-      expr_tag_t x_variant = e->args.x->variant;
-      expr_tag_t y_variant = e->args.y->variant;
+      expr_tag_t x_variant = expr_variant(e->args.x);
+      expr_tag_t y_variant = expr_variant(e->args.y);
       expr_t *x = e->args.x;
       expr_t *y = e->args.y;
 
       if ((x_variant == EXPR_CONSTANT) && (y_variant == EXPR_CONSTANT)) {
-        *e = Const(pow(x->constant, y->constant));
+        *e = Const(pow(expr_constant(x), expr_constant(y)));
         break;
       }
 
       simplify(x);
       simplify(y);
 
-      expr_t power = Power(x, y);
+      expr_t power = BinaryNode(EXPR_POWER, x, y);
       if (is_simplifiable(&power)) simplify(&power);
 
       *e = power;
@@ -535,17 +670,17 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_SIN: {
-      expr_tag_t x_variant = e->arg.x->variant;
+      expr_tag_t x_variant = expr_variant(e->arg.x);
       expr_t *x = e->arg.x;
 
       if (x_variant == EXPR_CONSTANT) {
-        *e = Const(sin(x->constant));
+        *e = Const(sin(expr_constant(x)));
         break;
       }
 
       simplify(x);
 
-      expr_t sin = Sin(x);
+      expr_t sin = UnaryNode(EXPR_SIN, x);
       if (is_simplifiable(&sin)) simplify(&sin);
 
       *e = sin;
@@ -553,17 +688,17 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_COS: {
-      expr_tag_t x_variant = e->arg.x->variant;
+      expr_tag_t x_variant = expr_variant(e->arg.x);
       expr_t *x = e->arg.x;
 
       if (x_variant == EXPR_CONSTANT) {
-        *e = Const(cos(x->constant));
+        *e = Const(cos(expr_constant(x)));
         break;
       }
 
       simplify(x);
 
-      expr_t cos = Cos(x);
+      expr_t cos = UnaryNode(EXPR_COS, x);
       if (is_simplifiable(&cos)) simplify(&cos);
 
       *e = cos;
@@ -571,17 +706,17 @@ void simplify(expr_t *e) {
     }
 
     case EXPR_TAN: {
-      expr_tag_t x_variant = e->arg.x->variant;
+      expr_tag_t x_variant = expr_variant(e->arg.x);
       expr_t *x = e->arg.x;
 
       if (x_variant == EXPR_CONSTANT) {
-        *e = Const(tan(x->constant));
+        *e = Const(tan(expr_constant(x)));
         break;
       }
 
       simplify(x);
 
-      expr_t tan = Tan(x);
+      expr_t tan = UnaryNode(EXPR_TAN, x);
       if (is_simplifiable(&tan)) simplify(&tan);
 
       *e = tan;
@@ -592,29 +727,29 @@ void simplify(expr_t *e) {
       expr_t *x = e->arg.x;
       simplify(x);
 
-      if (x->variant == EXPR_NEGATION) {
+      if (expr_variant(x) == EXPR_NEGATION) {
         if (is_simplifiable(x->arg.x)) simplify(x->arg.x);
 
-        *e = *x->arg.x;
+        *e = expr_load(x->arg.x);
         break;
       }
 
-      *e = Negation(x);
+      *e = UnaryNode(EXPR_NEGATION, x);
       break;
     }
 
     case EXPR_INVERSE: {
-      expr_tag_t x_variant = e->arg.x->variant;
+      expr_tag_t x_variant = expr_variant(e->arg.x);
       expr_t *x = e->arg.x;
 
       if (x_variant == EXPR_CONSTANT) {
-        *e = Const((f64)1.0 / x->constant);
+        *e = Const((f64)1.0 / expr_constant(x));
         break;
       }
 
       simplify(x);
 
-      expr_t inverse = Inverse(x);
+      expr_t inverse = UnaryNode(EXPR_INVERSE, x);
       if (is_simplifiable(&inverse)) simplify(&inverse);
 
       *e = inverse;
@@ -623,4 +758,210 @@ void simplify(expr_t *e) {
   }
 }
 
+expr_t *alloc_expr(allocator_t *allocator, expr_t e) {
+  expr_t *node = (expr_t*)allocator->alloc(sizeof(expr_t));
+
+  if (expr_is_inline(node)) {
+    puts("alloc_expr: allocator returned a top-bit tagged pointer, it would read as an inline leaf");
+    abort();
+  }
+
+  *node = e;
+  return node;
+}
+
+// a child slot for `leaf`: inline if it fits, else a node from `allocator`
+expr_t *alloc_leaf(allocator_t *allocator, expr_t leaf) {
+  if (leaf.variant == EXPR_VARIABLE) return expr_inline_variable(leaf.variable);
+  if ((leaf.variant == EXPR_CONSTANT) && expr_constant_fits_inline(leaf.constant)) return expr_inline_constant(leaf.constant);
+  return alloc_expr(allocator, leaf);
+}
+
+// frees a tree whose every node came from `allocator` (no shared subtrees)
+void free_expr(allocator_t *allocator, expr_t *e) {
+  if (expr_is_inline(e)) return;
+
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT:
+    case EXPR_VARIABLE: break;
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: {
+      free_expr(allocator, e->args.x);
+      free_expr(allocator, e->args.y);
+      break;
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: {
+      free_expr(allocator, e->arg.x);
+      break;
+    }
+
+    default:
+      puts("free_expr: corrupted/unhandled expression variant");
+      abort();
+  }
+
+  allocator->dealloc((u8*)e);
+}
+
+// `*fresh` tells whether the returned node was allocated by this call, so
+// a caller folding it away knows whether to free it
+static expr_t *simplify_persistent_node(expr_t *e, allocator_t *allocator, bool *fresh) {
+  *fresh = false;
+
+  // -(-x) is x, however many pairs deep
+  while ((expr_variant(e) == EXPR_NEGATION) && (expr_variant(e->arg.x) == EXPR_NEGATION)) e = e->arg.x->arg.x;
+
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT:
+    case EXPR_VARIABLE: return e;
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: {
+      bool x_fresh, y_fresh;
+      expr_t *x = simplify_persistent_node(e->args.x, allocator, &x_fresh);
+      expr_t *y = simplify_persistent_node(e->args.y, allocator, &y_fresh);
+
+      *fresh = true;
+
+      if ((expr_variant(x) == EXPR_CONSTANT) && (expr_variant(y) == EXPR_CONSTANT)) {
+        expr_t *folded = alloc_expr(allocator, Const(fold_constants(expr_variant(e), expr_constant(x), expr_constant(y))));
+        if (x_fresh) allocator->dealloc((u8*)x);
+        if (y_fresh) allocator->dealloc((u8*)y);
+        return folded;
+      }
+
+      if ((x == e->args.x) && (y == e->args.y)) {
+        *fresh = false;
+        return e;
+      }
+
+      return alloc_expr(allocator, (expr_t){ .args = (binary_expr_t){ .x = x, .y = y }, .variant = expr_variant(e) });
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_INVERSE: {
+      bool x_fresh;
+      expr_t *x = simplify_persistent_node(e->arg.x, allocator, &x_fresh);
+
+      *fresh = true;
+
+      if (expr_variant(x) == EXPR_CONSTANT) {
+        expr_t *folded = alloc_expr(allocator, Const(fold_constants(expr_variant(e), expr_constant(x), 0.0)));
+        if (x_fresh) allocator->dealloc((u8*)x);
+        return folded;
+      }
+
+      if (x == e->arg.x) {
+        *fresh = false;
+        return e;
+      }
+
+      return alloc_expr(allocator, (expr_t){ .arg = (unary_expr_t){ x }, .variant = expr_variant(e) });
+    }
+
+    case EXPR_NEGATION: {
+      // the child isn't a negation (see above), so neither is its simplification
+      bool x_fresh;
+      expr_t *x = simplify_persistent_node(e->arg.x, allocator, &x_fresh);
+
+      if (x == e->arg.x) return e;
+
+      *fresh = true;
+      return alloc_expr(allocator, UnaryNode(EXPR_NEGATION, x));
+    }
+
+    default:
+      puts("simplify_persistent: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+// non-destructive simplify(): gives the same tree simplify() would leave
+// behind, but never writes to `e`. unchanged subtrees are returned by
+// pointer and only the nodes on a changed path are allocated (from
+// `allocator`), so shared and concurrently read trees are safe to pass.
+// calling it from several threads at once also needs `allocator` to be
+// thread-safe (gpa_allocator is, its counter is atomic).
+// release the result with free_simplified().
+expr_t *simplify_persistent(expr_t *e, allocator_t *allocator) {
+  bool fresh;
+  expr_t *simplified = simplify_persistent_node(e, allocator, &fresh);
+
+  // -(-x) at the root can leave an inline leaf, and roots are always nodes
+  if (expr_is_inline(simplified)) return alloc_expr(allocator, expr_load(simplified));
+
+  return simplified;
+}
+
+// with `nodes` NULL this only counts them
+static void collect_expr_nodes(expr_t *e, expr_t **nodes, usize *len) {
+  if (nodes) nodes[*len] = e;
+  (*len)++;
+
+  if ((expr_variant(e) == EXPR_CONSTANT) || (expr_variant(e) == EXPR_VARIABLE)) return;
+
+  if (is_binary_expression(e)) {
+    collect_expr_nodes(e->args.x, nodes, len);
+    collect_expr_nodes(e->args.y, nodes, len);
+  } else {
+    collect_expr_nodes(e->arg.x, nodes, len);
+  }
+}
+
+static i32 expr_pointer_compare(const void *a, const void *b) {
+  uintptr_t pa = (uintptr_t)*(expr_t *const *)a;
+  uintptr_t pb = (uintptr_t)*(expr_t *const *)b;
+  return (pa > pb) - (pa < pb);
+}
+
+static void free_unshared(allocator_t *allocator, expr_t *e, expr_t **shared, usize num_shared) {
+  // anything reachable from the original was never ours to free
+  if (expr_is_inline(e)) return;
+  if (bsearch(&e, shared, num_shared, sizeof(expr_t*), expr_pointer_compare)) return;
+
+  if (is_binary_expression(e)) {
+    free_unshared(allocator, e->args.x, shared, num_shared);
+    free_unshared(allocator, e->args.y, shared, num_shared);
+  } else if ((expr_variant(e) != EXPR_CONSTANT) && (expr_variant(e) != EXPR_VARIABLE)) {
+    free_unshared(allocator, e->arg.x, shared, num_shared);
+  }
+
+  allocator->dealloc((u8*)e);
+}
+
+// frees the nodes simplify_persistent(original, allocator) allocated,
+// leaving everything it shares with `original` alone
+void free_simplified(allocator_t *allocator, expr_t *simplified, expr_t *original) {
+  if (simplified == original) return;
+
+  usize num_shared = 0;
+  collect_expr_nodes(original, NULL, &num_shared);
+  expr_t **shared = (expr_t**)allocator->alloc(sizeof(expr_t*) * num_shared);
+
+  num_shared = 0;
+  collect_expr_nodes(original, shared, &num_shared);
+  qsort(shared, num_shared, sizeof(expr_t*), expr_pointer_compare);
+
+  free_unshared(allocator, simplified, shared, num_shared);
+  allocator->dealloc((u8*)shared);
+}
+
 #endif
@@ -0,0 +1,614 @@
+#ifndef _LIBSEQ_FASTMATH_H
+#define _LIBSEQ_FASTMATH_H
+
+#include <stdbool.h>
+#include <math.h>
+#include <string.h>
+
+#include "primitives.h"
+
+// array kernels for sin/cos/tan/exp/log/pow on f64 and f32
+//
+// the kernels are written with gcc vector extensions (one native SIMD
+// register per vector: 2 x f64 / 4 x f32 on SSE/NEON, twice that with AVX)
+// using range reduction plus a polynomial, with lanes that fall outside the
+// reduction's range patched through libm.
+//
+// accuracy levels, with bounds measured against long double references
+// (see test/main.c):
+//
+//   FASTMATH_STRICT  libm, one call per element.
+//
+//   FASTMATH_ULP1    <= 1 ulp (worst seen 0.84). f64: fdlibm-style kernels,
+//                    sin/cos/tan reduce by pi/2 in fdlibm's four
+//                    Cody-Waite parts carried as a double-double, for
+//                    |x| <= 2^19 * pi/2 (nearest doubles to k * pi/2
+//                    included, see test/main.c).
+//                    f32: evaluated through the f64 kernels and rounded once.
+//                    f64 pow in this mode is libm's, since exp(y log x) needs
+//                    an extended precision log to stay within 1 ulp.
+//
+//   FASTMATH_FAST    f64: shorter polynomials, relative error < 1e-8.
+//                    f32: native f32 lanes (twice the f64 width) with
+//                    cephes-style polynomials, <= 4 f32 ulps (~2.5e-7
+//                    relative) for |x| <= 8192 in sin/cos/tan.
+//
+// f32 pow is the same in both non-strict modes: log2 and exp2 in f64 lanes
+// (powf_f64xN), worst seen 0.52 f32 ulp.
+//
+// special values (nan, +-inf, 0, negative log arguments, overflow and
+// underflow) follow libm. subnormal exp results may differ by an ulp.
+
+typedef enum : u8 {
+  FASTMATH_STRICT,
+  FASTMATH_ULP1,
+  FASTMATH_FAST
+} fastmath_accuracy_t;
+
+#if defined(__AVX__)
+  #define FASTMATH_VECTOR_BYTES 32
+#else
+  #define FASTMATH_VECTOR_BYTES 16
+#endif
+
+#define FASTMATH_F64_LANES (FASTMATH_VECTOR_BYTES / sizeof(f64))
+#define FASTMATH_F32_LANES (FASTMATH_VECTOR_BYTES / sizeof(f32))
+
+typedef f64 f64xN [[gnu::vector_size(FASTMATH_VECTOR_BYTES)]];
+typedef i64 i64xN [[gnu::vector_size(FASTMATH_VECTOR_BYTES)]];
+typedef f32 f32xN [[gnu::vector_size(FASTMATH_VECTOR_BYTES)]];
+typedef i32 i32xN [[gnu::vector_size(FASTMATH_VECTOR_BYTES)]];
+
+// f32 lanes widened to f64 take two registers' worth of f64
+typedef f32 f32xH [[gnu::vector_size(FASTMATH_VECTOR_BYTES / 2)]];
+
+static inline f64xN select_f64xN(i64xN mask, f64xN a, f64xN b) {
+  return (f64xN)(((i64xN)a & mask) | ((i64xN)b & ~mask));
+}
+
+static inline f32xN select_f32xN(i32xN mask, f32xN a, f32xN b) {
+  return (f32xN)(((i32xN)a & mask) | ((i32xN)b & ~mask));
+}
+
+static inline bool any_i64xN(i64xN mask) {
+  i64 any = 0;
+  for (usize i = 0; i < FASTMATH_F64_LANES; i++) any |= mask[i];
+  return any != 0;
+}
+
+static inline bool any_i32xN(i32xN mask) {
+  i32 any = 0;
+  for (usize i = 0; i < FASTMATH_F32_LANES; i++) any |= mask[i];
+  return any != 0;
+}
+
+static inline f64xN fabs_f64xN(f64xN x) {
+  return (f64xN)((i64xN)x & INT64_MAX);
+}
+
+static inline f32xN fabs_f32xN(f32xN x) {
+  return (f32xN)((i32xN)x & INT32_MAX);
+}
+
+// 2^n for n in the normal exponent range
+static inline f64xN exp2i_f64xN(i64xN n) {
+  return (f64xN)((n + 1023) << 52);
+}
+
+static inline f32xN exp2i_f32xN(i32xN n) {
+  return (f32xN)((n + 127) << 23);
+}
+
+// --- f64 ---
+
+static inline f64xN exp_f64xN(f64xN x, fastmath_accuracy_t accuracy) {
+  f64xN clamped = select_f64xN(x > 710.0, (f64xN){} + 710.0, x);
+  clamped = select_f64xN(clamped < -746.0, (f64xN){} + -746.0, clamped);
+
+  const f64 magic = 0x1.8p52;
+  f64xN k = (clamped * 1.44269504088896338700e+00 + magic) - magic;
+
+  f64xN hi = clamped - k * 6.93147180369123816490e-01;
+  f64xN lo = k * 1.90821492927058770002e-10;
+  f64xN r = hi - lo;
+
+  f64xN y;
+  if (accuracy == FASTMATH_FAST) {
+    y = 1.0 + r * (1.0 + r * (1.0 / 2 + r * (1.0 / 6 + r * (1.0 / 24 + r * (1.0 / 120 + r * (1.0 / 720 + r * (1.0 / 5040)))))));
+  } else {
+    f64xN t = r * r;
+    f64xN c = r - t * (1.66666666666666019037e-01 + t * (-2.77777777770155933842e-03 + t * (6.61375632143793436117e-05
+      + t * (-1.65339022054652515390e-06 + t * 4.13813679705723846039e-08))));
+    y = 1.0 - ((lo - (r * c) / (2.0 - c)) - hi);
+  }
+
+  // scaled in two halves so 2^k never leaves the normal range
+  i64xN n = __builtin_convertvector(k, i64xN);
+  i64xN half = n >> 1;
+  y = (y * exp2i_f64xN(half)) * exp2i_f64xN(n - half);
+
+  return select_f64xN(x != x, x, y);
+}
+
+static inline f64xN log_f64xN(f64xN x, fastmath_accuracy_t accuracy) {
+  i64xN tiny = x < 0x1p-1022;
+  f64xN scaled = select_f64xN(tiny, x * 0x1p54, x);
+
+  i64xN bits = (i64xN)scaled;
+  i64xN k = ((bits >> 52) & 0x7ff) - 1023 - (tiny & 54);
+  f64xN m = (f64xN)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+
+  i64xN above_sqrt2 = m > 1.41421356237309504880;
+  m = select_f64xN(above_sqrt2, m * 0.5, m);
+  k -= above_sqrt2;
+
+  f64xN dk = __builtin_convertvector(k, f64xN);
+  f64xN f = m - 1.0;
+  f64xN hfsq = 0.5 * f * f;
+  f64xN s = f / (2.0 + f);
+  f64xN z = s * s;
+
+  f64xN R;
+  if (accuracy == FASTMATH_FAST) {
+    R = z * (6.666666666666735130e-01 + z * (3.999999999940941908e-01 + z * (2.857142874366239149e-01 + z * 2.222219843214978396e-01)));
+  } else {
+    f64xN w = z * z;
+    f64xN t1 = w * (3.999999999940941908e-01 + w * (2.222219843214978396e-01 + w * 1.531383769920937332e-01));
+    f64xN t2 = z * (6.666666666666735130e-01 + w * (2.857142874366239149e-01 + w * (1.818357216161805012e-01 + w * 1.479819860511658591e-01)));
+    R = t2 + t1;
+  }
+
+  f64xN y = dk * 6.93147180369123816490e-01 - ((hfsq - (s * (hfsq + R) + dk * 1.90821492927058770002e-10)) - f);
+
+  y = select_f64xN(x == 0.0, (f64xN){} - INFINITY, y);
+  y = select_f64xN(x < 0.0, (f64xN){} + NAN, y);
+  y = select_f64xN(x == INFINITY, x, y);
+  return select_f64xN(x != x, x, y);
+}
+
+#define FASTMATH_SIN 0
+#define FASTMATH_COS 1
+#define FASTMATH_TAN 2
+
+#define FASTMATH_F64_TRIG_LIMIT (0x1p19 * 1.57079632679489661923)
+
+// fdlibm's __kernel_tan on x + tail, giving tan (odd lanes: -1/tan)
+static inline f64xN tan_kernel_f64xN(f64xN x, f64xN tail, i64xN odd) {
+  i64xN negative = x < 0.0;
+  i64xN big = fabs_f64xN(x) >= 0.6744;
+
+  // near +-pi/4 use tan(pi/4 - |x|) so the polynomial argument stays small
+  f64xN ax = select_f64xN(negative, -x, x);
+  f64xN atail = select_f64xN(negative, -tail, tail);
+  x = select_f64xN(big, (7.85398163397448278999e-01 - ax) + (3.06161699786838301793e-17 - atail), x);
+  tail = select_f64xN(big, (f64xN){}, tail);
+
+  f64xN z = x * x;
+  f64xN w = z * z;
+  f64xN r = 1.33333333333201242699e-01 + w * (2.18694882948595424599e-02 + w * (3.59207910759131235356e-03
+    + w * (5.88041240820264096874e-04 + w * (7.81794442939557092300e-05 + w * -1.85586374855275456654e-05))));
+  f64xN v = z * (5.39682539762260521377e-02 + w * (8.86323982359930005737e-03 + w * (1.45620945432529025516e-03
+    + w * (2.46463134818469906812e-04 + w * (7.14072491382608190305e-05 + w * 2.59073051863633712884e-05)))));
+  f64xN s = z * x;
+  r = tail + z * (s * (r + v) + tail);
+  r += 3.33333333333334091986e-01 * s;
+  w = x + r;
+
+  f64xN iy = select_f64xN(odd, (f64xN){} - 1.0, (f64xN){} + 1.0);
+  f64xN folded = iy - 2.0 * (x - (w * w / (w + iy) - r));
+  folded = select_f64xN(negative, -folded, folded);
+
+  // -1/(x + r) with the low half of w split off so nothing is lost
+  const i64 high_half = (i64)0xffffffff00000000ULL;
+  f64xN w_hi = (f64xN)((i64xN)w & high_half);
+  f64xN w_lo = r - (w_hi - x);
+  f64xN a = -1.0 / w;
+  f64xN t = (f64xN)((i64xN)a & high_half);
+  f64xN inverse = t + a * ((1.0 + t * w_hi) + t * w_lo);
+
+  return select_f64xN(big, folded, select_f64xN(odd, inverse, w));
+}
+
+static inline f64xN trig_f64xN(f64xN x, u8 function, fastmath_accuracy_t accuracy) {
+  const f64 magic = 0x1.8p52;
+  f64xN k = (x * 6.36619772367581382433e-01 + magic) - magic;
+
+  i64xN q = __builtin_convertvector(k, i64xN);
+  i64xN odd = -(q & 1);
+  const i64 sign = INT64_MIN;
+
+  // fdlibm's pi/2 = pio2_1 + pio2_2 + pio2_3 + pio2_3t, the first three 33
+  // bits wide so k * pio2_i is exact for k < 2^20. near a multiple of pi/2
+  // the result cancels down to ~2^-60 of x, so every step is an exact two-sum
+  // and all four parts are always applied (fdlibm only goes past pio2_2t
+  // when it sees the cancellation, which would be a branch per lane here)
+  f64xN hi = x - k * 1.57079632673412561417e+00;
+  f64xN mid = k * 6.07710050630396597660e-11;
+  f64xN r1 = hi - mid;
+  f64xN bv = r1 - hi;
+  f64xN err1 = (hi - (r1 - bv)) + (-mid - bv);
+
+  f64xN low = k * 2.02226624871116645580e-21;
+  f64xN r2 = r1 - low;
+  bv = r2 - r1;
+  f64xN err2 = (r1 - (r2 - bv)) + (-low - bv);
+
+  f64xN t = (err1 + err2) - k * 8.47842766036889956997e-32;
+  f64xN r = r2 + t;
+  f64xN tail = (r2 - r) + t;
+  f64xN z = r * r;
+
+  f64xN sin_r = {}, cos_r = {}, y = {};
+  if (accuracy == FASTMATH_FAST) {
+    sin_r = r + z * r * (-1.66666666666666324348e-01 + z * (8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z * 2.75573137070700676789e-06)));
+    cos_r = 1.0 - 0.5 * z + z * z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05 + z * -2.75573143513906633035e-07)));
+
+    if (function == FASTMATH_TAN) y = select_f64xN(odd, -cos_r / sin_r, sin_r / cos_r);
+  } else if (function == FASTMATH_TAN) {
+    y = tan_kernel_f64xN(r, tail, odd);
+  } else {
+    // fdlibm's __kernel_sin / __kernel_cos, carrying the reduction tail
+    f64xN v = z * r;
+    f64xN p = 8.33333333332248946124e-03 + z * (-1.98412698298579493134e-04 + z * (2.75573137070700676789e-06
+      + z * (-2.50507602534068634195e-08 + z * 1.58969099521155010221e-10)));
+    sin_r = r - ((z * (0.5 * tail - v * p) - tail) - v * -1.66666666666666324348e-01);
+
+    f64xN c = z * (4.16666666666666019037e-02 + z * (-1.38888888888741095749e-03 + z * (2.48015872894767294178e-05
+      + z * (-2.75573143513906633035e-07 + z * (2.08757232129817482790e-09 + z * -1.13596475577881948265e-11)))));
+    f64xN hz = 0.5 * z;
+    f64xN w = 1.0 - hz;
+    cos_r = w + (((1.0 - w) - hz) + (z * c - r * tail));
+  }
+
+  if (function == FASTMATH_SIN) {
+    y = select_f64xN(odd, cos_r, sin_r);
+    y = (f64xN)((i64xN)y ^ ((q << 62) & sign));
+  } else if (function == FASTMATH_COS) {
+    y = select_f64xN(odd, sin_r, cos_r);
+    y = (f64xN)((i64xN)y ^ (((q + 1) << 62) & sign));
+  }
+
+  // the compensated reduction turns -0 into +0, sin and tan are odd
+  if (function != FASTMATH_COS) y = select_f64xN(x == 0.0, x, y);
+
+  i64xN out_of_range = fabs_f64xN(x) > FASTMATH_F64_TRIG_LIMIT;
+  if (any_i64xN(out_of_range)) {
+    for (usize i = 0; i < FASTMATH_F64_LANES; i++) {
+      if (!out_of_range[i]) continue;
+      y[i] = (function == FASTMATH_SIN) ? sin(x[i]) : (function == FASTMATH_COS) ? cos(x[i]) : tan(x[i]);
+    }
+  }
+
+  return y;
+}
+
+static inline f64xN pow_f64xN(f64xN x, f64xN y, fastmath_accuracy_t accuracy) {
+  f64xN r = exp_f64xN(y * log_f64xN(x, FASTMATH_ULP1), accuracy);
+
+  // only positive finite bases with finite exponents take the fast path
+  i64xN libm = ~((x > 0.0) & (x < INFINITY) & (fabs_f64xN(y) < INFINITY));
+  if (any_i64xN(libm)) {
+    for (usize i = 0; i < FASTMATH_F64_LANES; i++)
+      if (libm[i]) r[i] = pow(x[i], y[i]);
+  }
+
+  return r;
+}
+
+// --- f32 ---
+
+// pow for f32 arguments carried in f64 lanes. log2 (2 atanh((m-1)/(m+1)),
+// |s| <= 0.172) and exp2 (|f| <= 0.5) are each good to ~1e-11 relative, so
+// while |y log2 x| stays below the clamp (past it the f32 result is 0 or inf)
+// the f64 result is well within 0.1 f32 ulp before its one rounding
+static inline f64xN powf_f64xN(f64xN x, f64xN y) {
+  i64xN bits = (i64xN)x;
+  i64xN e = ((bits >> 52) & 0x7ff) - 1023;
+  f64xN m = (f64xN)((bits & 0x000fffffffffffffLL) | 0x3ff0000000000000LL);
+
+  i64xN high = m > M_SQRT2;
+  m = select_f64xN(high, m * 0.5, m);
+  e -= high; // comparisons are -1 where true
+
+  f64xN s = (m - 1.0) / (m + 1.0);
+  f64xN s2 = s * s;
+  f64xN p = s2 * 0.2623081892525388 + 0.3205988979753252;
+  p = p * s2 + 0.41219858311113244;
+  p = p * s2 + 0.5770780163555853;
+  p = p * s2 + 0.9617966939259757;
+  p = p * s2 + 2.8853900817779268;
+
+  f64xN t = y * (__builtin_convertvector(e, f64xN) + s * p);
+  t = select_f64xN(t > 200.0, (f64xN){} + 200.0, t);
+  t = select_f64xN(t < -200.0, (f64xN){} + -200.0, t);
+
+  const f64 magic = 0x1.8p52;
+  f64xN k = (t + magic) - magic;
+  f64xN f = t - k;
+
+  f64xN q = f * 1.0178086009239696e-07 + 1.3215486790144305e-06;
+  q = q * f + 1.5252733804059838e-05;
+  q = q * f + 0.00015403530393381606;
+  q = q * f + 0.0013333558146428441;
+  q = q * f + 0.009618129107628477;
+  q = q * f + 0.055504108664821576;
+  q = q * f + 0.2402265069591007;
+  q = q * f + 0.6931471805599453;
+  q = q * f + 1.0;
+
+  f64xN r = q * (f64xN)((__builtin_convertvector(k, i64xN) + 1023) << 52);
+
+  // only positive finite bases with finite exponents take the fast path
+  i64xN libm = ~((x > 0.0) & (x < INFINITY) & (fabs_f64xN(y) < INFINITY));
+  if (any_i64xN(libm)) {
+    for (usize i = 0; i < FASTMATH_F64_LANES; i++)
+      if (libm[i]) r[i] = powf((f32)x[i], (f32)y[i]);
+  }
+
+  return r;
+}
+
+
+static inline f32xN exp_f32xN(f32xN x) {
+  f32xN clamped = select_f32xN(x > 89.0f, (f32xN){} + 89.0f, x);
+  clamped = select_f32xN(clamped < -104.0f, (f32xN){} + -104.0f, clamped);
+
+  const f32 magic = 0x1.8p23f;
+  f32xN k = (clamped * 1.44269504088896341f + magic) - magic;
+  f32xN r = (clamped - k * 0.693359375f) - k * -2.12194440e-4f;
+
+  f32xN p = (f32xN){} + 1.9875691500e-4f;
+  p = p * r + 1.3981999507e-3f;
+  p = p * r + 8.3334519073e-3f;
+  p = p * r + 4.1665795894e-2f;
+  p = p * r + 1.6666665459e-1f;
+  p = p * r + 5.0000001201e-1f;
+  f32xN y = p * r * r + r + 1.0f;
+
+  i32xN n = __builtin_convertvector(k, i32xN);
+  i32xN half = n >> 1;
+  y = (y * exp2i_f32xN(half)) * exp2i_f32xN(n - half);
+
+  return select_f32xN(x != x, x, y);
+}
+
+static inline f32xN log_f32xN(f32xN x) {
+  i32xN tiny = x < 0x1p-126f;
+  f32xN scaled = select_f32xN(tiny, x * 0x1p23f, x);
+
+  i32xN bits = (i32xN)scaled;
+  i32xN e = ((bits >> 23) & 0xff) - 127 - (tiny & 23);
+  f32xN m = (f32xN)((bits & 0x007fffff) | 0x3f800000);
+
+  i32xN above_sqrt2 = m > 1.41421356f;
+  m = select_f32xN(above_sqrt2, m * 0.5f, m);
+  e -= above_sqrt2;
+
+  f32xN fe = __builtin_convertvector(e, f32xN);
+  f32xN f = m - 1.0f;
+  f32xN z = f * f;
+
+  f32xN p = (f32xN){} + 7.0376836292e-2f;
+  p = p * f - 1.1514610310e-1f;
+  p = p * f + 1.1676998740e-1f;
+  p = p * f - 1.2420140846e-1f;
+  p = p * f + 1.4249322787e-1f;
+  p = p * f - 1.6668057665e-1f;
+  p = p * f + 2.0000714765e-1f;
+  p = p * f - 2.4999993993e-1f;
+  p = p * f + 3.3333331174e-1f;
+
+  f32xN y = p * z * f + fe * -2.12194440e-4f - 0.5f * z;
+  y = (f + y) + fe * 0.693359375f;
+
+  y = select_f32xN(x == 0.0f, (f32xN){} - INFINITY, y);
+  y = select_f32xN(x < 0.0f, (f32xN){} + NAN, y);
+  y = select_f32xN(x == INFINITY, x, y);
+  return select_f32xN(x != x, x, y);
+}
+
+#define FASTMATH_F32_TRIG_LIMIT 8192.0f
+
+static inline f32xN trig_f32xN(f32xN x, u8 function) {
+  const f32 magic = 0x1.8p23f;
+  f32xN k = (x * 0.636619772367581343f + magic) - magic;
+  // pi/2 in four parts, the first three 11 bits wide so k * part is exact for |k| < 2^13
+  f32xN r = (((x - k * 1.5703125f) - k * 4.837512969970703125e-4f) - k * 7.54953362047672271729e-8f) - k * 2.56334406825708960298e-12f;
+  f32xN z = r * r;
+
+  f32xN sin_r = ((-1.9515295891e-4f * z + 8.3321608736e-3f) * z - 1.6666654611e-1f) * z * r + r;
+  f32xN cos_r = ((2.443315711809948e-5f * z - 1.388731625493765e-3f) * z + 4.166664568298827e-2f) * z * z - 0.5f * z + 1.0f;
+
+  i32xN q = __builtin_convertvector(k, i32xN);
+  i32xN odd = -(q & 1);
+  const i32 sign = INT32_MIN;
+
+  f32xN y;
+  if (function == FASTMATH_SIN) {
+    y = select_f32xN(odd, cos_r, sin_r);
+    y = (f32xN)((i32xN)y ^ ((q << 30) & sign));
+  } else if (function == FASTMATH_COS) {
+    y = select_f32xN(odd, sin_r, cos_r);
+    y = (f32xN)((i32xN)y ^ (((q + 1) << 30) & sign));
+  } else {
+    y = select_f32xN(odd, -cos_r / sin_r, sin_r / cos_r);
+  }
+
+  i32xN out_of_range = fabs_f32xN(x) > FASTMATH_F32_TRIG_LIMIT;
+  if (any_i32xN(out_of_range)) {
+    for (usize i = 0; i < FASTMATH_F32_LANES; i++) {
+      if (!out_of_range[i]) continue;
+      y[i] = (function == FASTMATH_SIN) ? sinf(x[i]) : (function == FASTMATH_COS) ? cosf(x[i]) : tanf(x[i]);
+    }
+  }
+
+  return y;
+}
+
+// --- array drivers ---
+
+typedef enum : u8 {
+  FASTMATH_OP_SIN = FASTMATH_SIN,
+  FASTMATH_OP_COS = FASTMATH_COS,
+  FASTMATH_OP_TAN = FASTMATH_TAN,
+  FASTMATH_OP_EXP,
+  FASTMATH_OP_LOG,
+  FASTMATH_OP_POW
+} fastmath_op_t;
+
+static inline f64 fastmath_libm_f64(fastmath_op_t op, f64 x, f64 y) {
+  switch (op) {
+    case FASTMATH_OP_SIN: return sin(x);
+    case FASTMATH_OP_COS: return cos(x);
+    case FASTMATH_OP_TAN: return tan(x);
+    case FASTMATH_OP_EXP: return exp(x);
+    case FASTMATH_OP_LOG: return log(x);
+    case FASTMATH_OP_POW: return pow(x, y);
+  }
+
+  return NAN;
+}
+
+static inline f32 fastmath_libm_f32(fastmath_op_t op, f32 x, f32 y) {
+  switch (op) {
+    case FASTMATH_OP_SIN: return sinf(x);
+    case FASTMATH_OP_COS: return cosf(x);
+    case FASTMATH_OP_TAN: return tanf(x);
+    case FASTMATH_OP_EXP: return expf(x);
+    case FASTMATH_OP_LOG: return logf(x);
+    case FASTMATH_OP_POW: return powf(x, y);
+  }
+
+  return NAN;
+}
+
+[[gnu::always_inline]]
+static inline f64xN fastmath_kernel_f64xN(fastmath_op_t op, f64xN x, f64xN y, fastmath_accuracy_t accuracy) {
+  switch (op) {
+    case FASTMATH_OP_SIN:
+    case FASTMATH_OP_COS:
+    case FASTMATH_OP_TAN: return trig_f64xN(x, (u8)op, accuracy);
+    case FASTMATH_OP_EXP: return exp_f64xN(x, accuracy);
+    case FASTMATH_OP_LOG: return log_f64xN(x, accuracy);
+    case FASTMATH_OP_POW: return pow_f64xN(x, y, accuracy);
+  }
+
+  return x;
+}
+
+[[gnu::always_inline]]
+static inline f32xN fastmath_kernel_f32xN(fastmath_op_t op, f32xN x, f32xN y) {
+  switch (op) {
+    case FASTMATH_OP_SIN:
+    case FASTMATH_OP_COS:
+    case FASTMATH_OP_TAN: return trig_f32xN(x, (u8)op);
+    case FASTMATH_OP_EXP: return exp_f32xN(x);
+    case FASTMATH_OP_LOG: return log_f32xN(x);
+    case FASTMATH_OP_POW: {
+      // exp(y log x) in f32 loses |y log x| ulps, so pow is widened instead
+      f32xN r;
+      for (usize h = 0; h < 2; h++) {
+        f32xH xh, yh;
+        memcpy(&xh, (f32*)&x + h * FASTMATH_F64_LANES, sizeof(xh));
+        memcpy(&yh, (f32*)&y + h * FASTMATH_F64_LANES, sizeof(yh));
+
+        f64xN wide = powf_f64xN(__builtin_convertvector(xh, f64xN), __builtin_convertvector(yh, f64xN));
+        f32xH narrow = __builtin_convertvector(wide, f32xH);
+        memcpy((f32*)&r + h * FASTMATH_F64_LANES, &narrow, sizeof(narrow));
+      }
+      return r;
+    }
+  }
+
+  return x;
+}
+
+[[gnu::always_inline]]
+static inline void fastmath_map_f64(fastmath_op_t op, f64 *out, const f64 *x, const f64 *y, usize n, fastmath_accuracy_t accuracy) {
+  if ((accuracy == FASTMATH_STRICT) || ((op == FASTMATH_OP_POW) && (accuracy == FASTMATH_ULP1))) {
+    for (usize i = 0; i < n; i++) out[i] = fastmath_libm_f64(op, x[i], y ? y[i] : 0.0);
+    return;
+  }
+
+  usize i = 0;
+  for (; i + FASTMATH_F64_LANES <= n; i += FASTMATH_F64_LANES) {
+    f64xN vx, vy = {};
+    memcpy(&vx, x + i, sizeof(vx));
+    if (y) memcpy(&vy, y + i, sizeof(vy));
+
+    f64xN r = fastmath_kernel_f64xN(op, vx, vy, accuracy);
+    memcpy(out + i, &r, sizeof(r));
+  }
+
+  if (i < n) {
+    // pad the tail with 1.0, which is in every kernel's domain
+    f64xN vx = (f64xN){} + 1.0, vy = (f64xN){} + 1.0;
+    memcpy(&vx, x + i, sizeof(f64) * (n - i));
+    if (y) memcpy(&vy, y + i, sizeof(f64) * (n - i));
+
+    f64xN r = fastmath_kernel_f64xN(op, vx, vy, accuracy);
+    memcpy(out + i, &r, sizeof(f64) * (n - i));
+  }
+}
+
+[[gnu::always_inline]]
+static inline void fastmath_map_f32(fastmath_op_t op, f32 *out, const f32 *x, const f32 *y, usize n, fastmath_accuracy_t accuracy) {
+  if (accuracy == FASTMATH_STRICT) {
+    for (usize i = 0; i < n; i++) out[i] = fastmath_libm_f32(op, x[i], y ? y[i] : 0.0f);
+    return;
+  }
+
+  if (accuracy == FASTMATH_ULP1) {
+    // the f64 kernels' error is far below half an f32 ulp, so one rounding
+    // on the way back keeps us within 1 ulp
+    for (usize i = 0; i < n; i += FASTMATH_F64_LANES) {
+      usize len = (n - i < FASTMATH_F64_LANES) ? n - i : FASTMATH_F64_LANES;
+      f32xH vx = (f32xH){} + 1.0f, vy = (f32xH){} + 1.0f;
+      memcpy(&vx, x + i, sizeof(f32) * len);
+      if (y) memcpy(&vy, y + i, sizeof(f32) * len);
+
+      f64xN wx = __builtin_convertvector(vx, f64xN), wy = __builtin_convertvector(vy, f64xN);
+      f64xN r = (op == FASTMATH_OP_POW) ? powf_f64xN(wx, wy) : fastmath_kernel_f64xN(op, wx, wy, FASTMATH_ULP1);
+      f32xH narrow = __builtin_convertvector(r, f32xH);
+      memcpy(out + i, &narrow, sizeof(f32) * len);
+    }
+    return;
+  }
+
+  usize i = 0;
+  for (; i + FASTMATH_F32_LANES <= n; i += FASTMATH_F32_LANES) {
+    f32xN vx, vy = {};
+    memcpy(&vx, x + i, sizeof(vx));
+    if (y) memcpy(&vy, y + i, sizeof(vy));
+
+    f32xN r = fastmath_kernel_f32xN(op, vx, vy);
+    memcpy(out + i, &r, sizeof(r));
+  }
+
+  if (i < n) {
+    f32xN vx = (f32xN){} + 1.0f, vy = (f32xN){} + 1.0f;
+    memcpy(&vx, x + i, sizeof(f32) * (n - i));
+    if (y) memcpy(&vy, y + i, sizeof(f32) * (n - i));
+
+    f32xN r = fastmath_kernel_f32xN(op, vx, vy);
+    memcpy(out + i, &r, sizeof(f32) * (n - i));
+  }
+}
+
+// out may alias x (and y)
+
+void fastmath_sin_f64(f64 *out, const f64 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f64(FASTMATH_OP_SIN, out, x, NULL, n, accuracy); }
+void fastmath_cos_f64(f64 *out, const f64 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f64(FASTMATH_OP_COS, out, x, NULL, n, accuracy); }
+void fastmath_tan_f64(f64 *out, const f64 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f64(FASTMATH_OP_TAN, out, x, NULL, n, accuracy); }
+void fastmath_exp_f64(f64 *out, const f64 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f64(FASTMATH_OP_EXP, out, x, NULL, n, accuracy); }
+void fastmath_log_f64(f64 *out, const f64 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f64(FASTMATH_OP_LOG, out, x, NULL, n, accuracy); }
+void fastmath_pow_f64(f64 *out, const f64 *x, const f64 *y, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f64(FASTMATH_OP_POW, out, x, y, n, accuracy); }
+
+void fastmath_sin_f32(f32 *out, const f32 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f32(FASTMATH_OP_SIN, out, x, NULL, n, accuracy); }
+void fastmath_cos_f32(f32 *out, const f32 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f32(FASTMATH_OP_COS, out, x, NULL, n, accuracy); }
+void fastmath_tan_f32(f32 *out, const f32 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f32(FASTMATH_OP_TAN, out, x, NULL, n, accuracy); }
+void fastmath_exp_f32(f32 *out, const f32 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f32(FASTMATH_OP_EXP, out, x, NULL, n, accuracy); }
+void fastmath_log_f32(f32 *out, const f32 *x, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f32(FASTMATH_OP_LOG, out, x, NULL, n, accuracy); }
+void fastmath_pow_f32(f32 *out, const f32 *x, const f32 *y, usize n, fastmath_accuracy_t accuracy) { fastmath_map_f32(FASTMATH_OP_POW, out, x, y, n, accuracy); }
+
+#endif
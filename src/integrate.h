@@ -0,0 +1,455 @@
+#ifndef _LIBSEQ_INTEGRATE_H
+#define _LIBSEQ_INTEGRATE_H
+
+#include <stdbool.h>
+#include <math.h>
+#include <float.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+#include "fastmath.h"
+#include "evaluate.h"
+
+// adaptive numerical integration
+//
+// the box is cut into one slice per worker along its widest axis, and each
+// worker starts on its own slice. after that regions (intervals, or boxes
+// for several variables) sit in one shared work queue. workers pop their
+// share of it (queued / threads regions, at most as many as fill
+// INTEGRATE_BATCH_POINTS nodes), evaluate every node of all of them in a
+// single evaluate_batch() call, and either accept a region or push its two
+// halves back. intervals
+// use 15 point gauss-kronrod, boxes the degree 7 genz-malik rule (with its
+// embedded degree 5 rule for the error and its fourth differences picking
+// the axis to split).
+//
+// a region is accepted once its error estimate is within its share of the
+// tolerance (tolerance * its volume / the total volume), so no region has to
+// wait on the others and the accepted errors add up to at most `tolerance`.
+
+#define INTEGRATE_MAX_DIMS 8
+#define INTEGRATE_BATCH_POINTS 2048
+#define INTEGRATE_MAX_THREADS 64
+
+typedef struct {
+  u32 threads;        // 0 for one per online cpu
+  u32 max_depth;      // a region split this many times is accepted as is
+  usize max_regions;  // regions evaluated before the rest are accepted as is
+  fastmath_accuracy_t accuracy;
+} integrate_options_t;
+
+#define INTEGRATE_DEFAULTS ((integrate_options_t){ .threads = 0, .max_depth = 48, .max_regions = 1 << 20, .accuracy = FASTMATH_ULP1 })
+
+typedef struct {
+  f64 value;
+  f64 error;          // estimated absolute error
+  usize regions;      // regions evaluated
+  u32 workers;        // threads that evaluated at least one region
+  bool converged;     // error within tolerance, no region accepted early
+} integral_t;
+
+typedef struct {
+  f64 center[INTEGRATE_MAX_DIMS], half[INTEGRATE_MAX_DIMS];
+  u32 depth;
+} integrate_region_t;
+
+typedef struct {
+  expr_t *f;
+  const char *variables;
+  usize dims, rule_points, batch_regions;
+  f64 tolerance, volume;
+  integrate_options_t options;
+  allocator_t *allocator;
+
+  // everything below is guarded by `lock`
+  pthread_mutex_t lock;
+  pthread_cond_t ready;
+  integrate_region_t *queue;
+  usize queued, capacity, busy, evaluated;
+  u32 threads;
+  f64 value, error;
+  bool truncated;
+} integrator_t;
+
+// 15 point kronrod nodes on [-1, 1] (the positive half, mirrored), the 7 point
+// gauss rule uses the odd ones
+static const f64 gk15_nodes[8] = {
+  0.991455371120812639206854697526329, 0.949107912342758524526189684047851,
+  0.864864423359769072789712788640926, 0.741531185599394439863864773280788,
+  0.586087235467691130294144845693013, 0.405845151377397166906606412076961,
+  0.207784955007898467600689403773245, 0.0,
+};
+
+static const f64 gk15_kronrod_weights[8] = {
+  0.022935322010529224963732008058970, 0.063092092629978553290700663189204,
+  0.104790010322250183839876322541518, 0.140653259715525918745189590510238,
+  0.169004726639267902826583426598550, 0.190350578064785409913256402421014,
+  0.204432940075298892414161999234649, 0.209482141084727828012999174891714,
+};
+
+static const f64 gk15_gauss_weights[4] = {
+  0.129484966168869693270611432679082, 0.279705391489276667901467771423780,
+  0.381830050505118944950369775488975, 0.417959183673469387755102040816327,
+};
+
+typedef struct {
+  integrator_t *it;
+  integrate_region_t slice; // evaluated before the worker turns to the queue
+  usize regions;            // regions this worker evaluated
+  pthread_t thread;
+} integrate_worker_t;
+
+static usize integrate_rule_points(usize dims) {
+  if (dims == 1) return 15;
+  return 1 + 4 * dims + 2 * dims * (dims - 1) + ((usize)1 << dims);
+}
+
+static f64 integrate_region_volume(integrator_t *it, integrate_region_t *r) {
+  f64 volume = 1.0;
+  for (usize d = 0; d < it->dims; d++) volume *= 2.0 * r->half[d];
+  return volume;
+}
+
+// writes the rule's nodes for `r` at coords[d][offset...]
+static void integrate_fill_nodes(integrator_t *it, integrate_region_t *r, f64 **coords, usize offset) {
+  usize p = offset;
+
+  if (it->dims == 1) {
+    coords[0][p++] = r->center[0];
+    for (usize j = 0; j < 7; j++) {
+      coords[0][p++] = r->center[0] + r->half[0] * gk15_nodes[j];
+      coords[0][p++] = r->center[0] - r->half[0] * gk15_nodes[j];
+    }
+    return;
+  }
+
+  // genz-malik: center, 2 points per axis at l2 and at l3, 4 per axis pair
+  // at l3 and every corner at l5
+  const f64 l2 = sqrt(9.0 / 70.0), l3 = sqrt(9.0 / 10.0), l5 = sqrt(9.0 / 19.0);
+
+  for (usize n = 0; n < it->rule_points; n++)
+    for (usize d = 0; d < it->dims; d++) coords[d][p + n] = r->center[d];
+
+  p++;
+
+  for (usize i = 0; i < it->dims; i++) {
+    coords[i][p++] += l2 * r->half[i];
+    coords[i][p++] -= l2 * r->half[i];
+    coords[i][p++] += l3 * r->half[i];
+    coords[i][p++] -= l3 * r->half[i];
+  }
+
+  for (usize i = 0; i < it->dims; i++) {
+    for (usize j = i + 1; j < it->dims; j++) {
+      for (usize s = 0; s < 4; s++, p++) {
+        coords[i][p] += ((s & 1) ? -l3 : l3) * r->half[i];
+        coords[j][p] += ((s & 2) ? -l3 : l3) * r->half[j];
+      }
+    }
+  }
+
+  for (usize corner = 0; corner < ((usize)1 << it->dims); corner++, p++)
+    for (usize d = 0; d < it->dims; d++)
+      coords[d][p] += ((corner >> d) & 1) ? -l5 * r->half[d] : l5 * r->half[d];
+}
+
+// estimate and error of `r` from its node values, and the axis to split it on
+static void integrate_apply_rule(integrator_t *it, integrate_region_t *r, const f64 *fx, f64 *value, f64 *error, usize *axis) {
+  *axis = 0;
+
+  if (it->dims == 1) {
+    f64 h = r->half[0];
+    f64 f0 = fx[0];
+    f64 kronrod = gk15_kronrod_weights[7] * f0, gauss = gk15_gauss_weights[3] * f0;
+    f64 absolute = fabs(kronrod);
+
+    for (usize j = 0; j < 7; j++) {
+      f64 pair = fx[1 + 2 * j] + fx[2 + 2 * j];
+      kronrod += gk15_kronrod_weights[j] * pair;
+      absolute += gk15_kronrod_weights[j] * (fabs(fx[1 + 2 * j]) + fabs(fx[2 + 2 * j]));
+      if (j & 1) gauss += gk15_gauss_weights[j / 2] * pair;
+    }
+
+    // quadpack's scaling of |kronrod - gauss|, which on its own grossly
+    // overstates the error of the 15 point result
+    f64 mean = kronrod * 0.5;
+    f64 spread = gk15_kronrod_weights[7] * fabs(f0 - mean);
+    for (usize j = 0; j < 7; j++)
+      spread += gk15_kronrod_weights[j] * (fabs(fx[1 + 2 * j] - mean) + fabs(fx[2 + 2 * j] - mean));
+
+    f64 e = fabs((kronrod - gauss) * h);
+    spread *= fabs(h);
+    if ((spread != 0.0) && (e != 0.0)) e = spread * fmin(1.0, pow(200.0 * e / spread, 1.5));
+    if (fabs(absolute * h) > DBL_MIN / (50.0 * DBL_EPSILON)) e = fmax(50.0 * DBL_EPSILON * fabs(absolute * h), e);
+
+    *value = kronrod * h;
+    *error = e;
+    return;
+  }
+
+  f64 d = (f64)it->dims;
+  f64 w1 = (12824.0 - 9120.0 * d + 400.0 * d * d) / 19683.0, w2 = 980.0 / 6561.0, w3 = (1820.0 - 400.0 * d) / 19683.0;
+  f64 w4 = 200.0 / 19683.0, w5 = 6859.0 / 19683.0 / (f64)((usize)1 << it->dims);
+  f64 e1 = (729.0 - 950.0 * d + 50.0 * d * d) / 729.0, e2 = 245.0 / 486.0, e3 = (265.0 - 100.0 * d) / 1458.0, e4 = 25.0 / 729.0;
+
+  f64 f0 = fx[0];
+  f64 sum2 = 0.0, sum3 = 0.0, sum4 = 0.0, sum5 = 0.0, sharpest = -1.0;
+  usize p = 1;
+
+  for (usize i = 0; i < it->dims; i++, p += 4) {
+    f64 inner = fx[p] + fx[p + 1], outer = fx[p + 2] + fx[p + 3];
+    sum2 += inner;
+    sum3 += outer;
+
+    // fourth difference along i, the axis where f bends the most gets split
+    f64 bend = fabs(inner - 2.0 * f0 - (outer - 2.0 * f0) / 7.0);
+    if ((bend > sharpest) || ((bend == sharpest) && (fabs(r->half[i]) > fabs(r->half[*axis])))) {
+      sharpest = bend;
+      *axis = i;
+    }
+  }
+
+  for (usize n = 0; n < 2 * it->dims * (it->dims - 1); n++) sum4 += fx[p++];
+  for (usize n = 0; n < ((usize)1 << it->dims); n++) sum5 += fx[p++];
+
+  f64 volume = integrate_region_volume(it, r);
+  *value = volume * (w1 * f0 + w2 * sum2 + w3 * sum3 + w4 * sum4 + w5 * sum5);
+  *error = fabs(*value - volume * (e1 * f0 + e2 * sum2 + e3 * sum3 + e4 * sum4));
+}
+
+static void integrate_push(integrator_t *it, integrate_region_t *regions, usize n) {
+  if (it->queued + n > it->capacity) {
+    usize capacity = (it->capacity > 0) ? it->capacity : 64;
+    while (capacity < it->queued + n) capacity *= 2;
+
+    integrate_region_t *queue = (integrate_region_t*)it->allocator->alloc(sizeof(integrate_region_t) * capacity);
+    if (it->queued > 0) memcpy(queue, it->queue, sizeof(integrate_region_t) * it->queued);
+    if (it->queue) it->allocator->dealloc((u8*)it->queue);
+
+    it->queue = queue;
+    it->capacity = capacity;
+  }
+
+  memcpy(it->queue + it->queued, regions, sizeof(integrate_region_t) * n);
+  it->queued += n;
+}
+
+static void *integrate_worker(void *arg) {
+  integrate_worker_t *w = (integrate_worker_t*)arg;
+  integrator_t *it = w->it;
+  allocator_t *a = it->allocator;
+
+  usize points = it->batch_regions * it->rule_points;
+  integrate_region_t *regions = (integrate_region_t*)a->alloc(sizeof(integrate_region_t) * it->batch_regions);
+  integrate_region_t *halves = (integrate_region_t*)a->alloc(sizeof(integrate_region_t) * it->batch_regions * 2);
+  f64 *nodes = (f64*)a->alloc(sizeof(f64) * points * it->dims);
+  f64 *fx = (f64*)a->alloc(sizeof(f64) * points);
+
+  f64 *coords[INTEGRATE_MAX_DIMS];
+  const f64 *values[INTEGRATE_MAX_DIMS];
+  for (usize d = 0; d < it->dims; d++) values[d] = coords[d] = nodes + d * points;
+
+  // the starting slice is already counted as evaluated and busy
+  regions[0] = w->slice;
+  usize taken = 1;
+
+  pthread_mutex_lock(&it->lock);
+  bool may_split = it->evaluated < it->options.max_regions;
+  pthread_mutex_unlock(&it->lock);
+
+  for (;;) {
+    w->regions += taken;
+
+    for (usize r = 0; r < taken; r++) integrate_fill_nodes(it, &regions[r], coords, r * it->rule_points);
+    evaluate_batch(fx, it->f, it->variables, values, taken * it->rule_points, it->options.accuracy, a);
+
+    f64 value = 0.0, error = 0.0;
+    usize split = 0;
+    bool truncated = false;
+
+    for (usize r = 0; r < taken; r++) {
+      integrate_region_t *region = &regions[r];
+      f64 v, e;
+      usize axis;
+      integrate_apply_rule(it, region, fx + r * it->rule_points, &v, &e, &axis);
+
+      f64 share = it->tolerance * fabs(integrate_region_volume(it, region) / it->volume);
+      bool stuck = !isfinite(e) || (region->depth >= it->options.max_depth) || !may_split;
+
+      if ((e <= share) || stuck) {
+        value += v;
+        error += e;
+        truncated = truncated || (e > share);
+        continue;
+      }
+
+      integrate_region_t lower = *region;
+      lower.half[axis] *= 0.5;
+      lower.depth++;
+
+      integrate_region_t upper = lower;
+      lower.center[axis] -= lower.half[axis];
+      upper.center[axis] += upper.half[axis];
+
+      halves[split++] = lower;
+      halves[split++] = upper;
+    }
+
+    pthread_mutex_lock(&it->lock);
+
+    if (split > 0) integrate_push(it, halves, split);
+    it->value += value;
+    it->error += error;
+    it->truncated = it->truncated || truncated;
+    it->busy--;
+
+    pthread_cond_broadcast(&it->ready);
+
+    while ((it->queued == 0) && (it->busy > 0)) pthread_cond_wait(&it->ready, &it->lock);
+    if (it->queued == 0) break; // nothing queued and nobody left to queue more
+
+    // only this worker's share, so the others find work too
+    taken = it->queued / it->threads;
+    if (taken == 0) taken = 1;
+    if (taken > it->batch_regions) taken = it->batch_regions;
+
+    it->queued -= taken;
+    memcpy(regions, it->queue + it->queued, sizeof(integrate_region_t) * taken);
+
+    it->evaluated += taken;
+    may_split = it->evaluated < it->options.max_regions;
+    it->busy++;
+
+    pthread_mutex_unlock(&it->lock);
+  }
+
+  pthread_mutex_unlock(&it->lock);
+
+  a->dealloc((u8*)regions);
+  a->dealloc((u8*)halves);
+  a->dealloc((u8*)nodes);
+  a->dealloc((u8*)fx);
+  return NULL;
+}
+
+// integral of `f` over the box lower[d] <= variables[d] <= upper[d]. `f` may
+// only use `variables` (at most INTEGRATE_MAX_DIMS of them). the workers
+// allocate their scratch and evaluate_batch()'s from `allocator`
+// concurrently, so unless options.threads is 1 it has to be thread-safe
+// (gpa_allocator is)
+integral_t integrate_with(expr_t *f, const char *variables, const f64 *lower, const f64 *upper, f64 tolerance,
+                          integrate_options_t options, allocator_t *allocator) {
+  usize dims = strlen(variables);
+
+  if ((dims == 0) || (dims > INTEGRATE_MAX_DIMS)) {
+    puts("integrate_with: unsupported number of variables");
+    abort();
+  }
+
+  integrator_t it = {
+    .f = f,
+    .variables = variables,
+    .dims = dims,
+    .rule_points = integrate_rule_points(dims),
+    .tolerance = tolerance,
+    .volume = 1.0,
+    .options = options,
+    .allocator = allocator,
+  };
+
+  it.batch_regions = INTEGRATE_BATCH_POINTS / it.rule_points;
+  if (it.batch_regions == 0) it.batch_regions = 1;
+
+  integrate_region_t whole = { .depth = 0 };
+  usize widest = 0;
+
+  for (usize d = 0; d < dims; d++) {
+    whole.center[d] = 0.5 * (lower[d] + upper[d]);
+    whole.half[d] = 0.5 * (upper[d] - lower[d]);
+    it.volume *= upper[d] - lower[d];
+    if (fabs(whole.half[d]) > fabs(whole.half[widest])) widest = d;
+  }
+
+  if (it.volume == 0.0) return (integral_t){ .value = 0.0, .error = 0.0, .regions = 0, .converged = true };
+
+  u32 threads = options.threads;
+  if (threads == 0) {
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = (online > 0) ? (u32)online : 1;
+  }
+  if (threads > INTEGRATE_MAX_THREADS) threads = INTEGRATE_MAX_THREADS;
+
+  pthread_mutex_init(&it.lock, NULL);
+  pthread_cond_init(&it.ready, NULL);
+
+  // every worker owns a starting slice, so all of them count as busy
+  // before any has started
+  integrate_worker_t workers[INTEGRATE_MAX_THREADS];
+  it.threads = threads;
+  it.busy = threads;
+  it.evaluated = threads;
+
+  for (u32 t = 0; t < threads; t++) {
+    workers[t] = (integrate_worker_t){ .it = &it, .slice = whole };
+    workers[t].slice.half[widest] = whole.half[widest] / (f64)threads;
+    workers[t].slice.center[widest] = lower[widest] + (2.0 * (f64)t + 1.0) * workers[t].slice.half[widest];
+  }
+
+  bool started[INTEGRATE_MAX_THREADS] = { false };
+
+  for (u32 t = 1; t < threads; t++) {
+    started[t] = pthread_create(&workers[t].thread, NULL, integrate_worker, &workers[t]) == 0;
+    if (started[t]) continue;
+
+    // no thread for this slice, it goes to the queue for the others
+    pthread_mutex_lock(&it.lock);
+    integrate_push(&it, &workers[t].slice, 1);
+    it.threads--;
+    it.busy--;
+    it.evaluated--;
+    pthread_cond_broadcast(&it.ready);
+    pthread_mutex_unlock(&it.lock);
+  }
+
+  integrate_worker(&workers[0]);
+
+  u32 working = (workers[0].regions > 0) ? 1 : 0;
+
+  for (u32 t = 1; t < threads; t++) {
+    if (!started[t]) continue;
+    pthread_join(workers[t].thread, NULL);
+    if (workers[t].regions > 0) working++;
+  }
+
+  pthread_cond_destroy(&it.ready);
+  pthread_mutex_destroy(&it.lock);
+  if (it.queue) allocator->dealloc((u8*)it.queue);
+
+  return (integral_t){
+    .value = it.value,
+    .error = it.error,
+    .regions = it.evaluated,
+    .workers = working,
+    .converged = !it.truncated && (it.error <= tolerance),
+  };
+}
+
+// integral of `f` over a <= `variable` <= b, on every cpu (so `allocator`
+// has to be thread-safe, see integrate_with())
+integral_t integrate(expr_t *f, char variable, f64 a, f64 b, f64 tolerance, allocator_t *allocator) {
+  char variables[2] = { variable, '\0' };
+  return integrate_with(f, variables, &a, &b, tolerance, INTEGRATE_DEFAULTS, allocator);
+}
+
+// integral of `f` over lower[d] <= variables[d] <= upper[d], on every cpu
+integral_t integrate_box(expr_t *f, const char *variables, const f64 *lower, const f64 *upper, f64 tolerance, allocator_t *allocator) {
+  return integrate_with(f, variables, lower, upper, tolerance, INTEGRATE_DEFAULTS, allocator);
+}
+
+#endif
@@ -0,0 +1,537 @@
+#ifndef _LIBSEQ_POLYNOMIAL_H
+#define _LIBSEQ_POLYNOMIAL_H
+
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+
+// sparse multivariate polynomials over f64
+//
+// a monomial is packed into a u64 with one u8 exponent per variable, the
+// first variable in the most significant byte. comparing two packed
+// monomials as integers is then lexicographic order, and multiplying two
+// monomials is a single integer addition.
+//
+// terms are kept sorted by descending monomial with like terms collected
+// and zero coefficients dropped.
+
+#define POLY_MAX_VARIABLES 8
+#define POLY_MAX_DEGREE 255
+
+typedef u64 monomial_t;
+
+typedef struct {
+  monomial_t monomial;
+  f64 coefficient;
+} poly_term_t;
+
+typedef struct {
+  poly_term_t *terms;
+  usize len, cap;
+
+  char variables[POLY_MAX_VARIABLES];
+  u8 num_variables;
+
+  allocator_t *allocator;
+} poly_t;
+
+static inline u8 monomial_exponent(monomial_t m, u8 variable_index) {
+  return (u8)(m >> (8 * (POLY_MAX_VARIABLES - 1 - variable_index)));
+}
+
+static inline monomial_t monomial_of(u8 variable_index, u8 exponent) {
+  return (monomial_t)exponent << (8 * (POLY_MAX_VARIABLES - 1 - variable_index));
+}
+
+static inline bool monomial_product_overflows(monomial_t a, monomial_t b) {
+  monomial_t sum = a + b;
+  // a carry out of any byte shows up as a flipped low bit in the byte above it
+  return (sum < a) || (((a ^ b ^ sum) & 0x0101010101010100ULL) != 0);
+}
+
+static void poly_reserve(poly_t *p, usize cap) {
+  if (cap <= p->cap) return;
+
+  poly_term_t *terms = (poly_term_t*)p->allocator->alloc(sizeof(poly_term_t) * cap);
+  if (p->terms) {
+    memcpy(terms, p->terms, sizeof(poly_term_t) * p->len);
+    p->allocator->dealloc((u8*)p->terms);
+  }
+
+  p->terms = terms;
+  p->cap = cap;
+}
+
+static void poly_push_term(poly_t *p, monomial_t monomial, f64 coefficient) {
+  if (p->len == p->cap) poly_reserve(p, p->cap ? p->cap * 2 : 4);
+  p->terms[p->len++] = (poly_term_t){ .monomial = monomial, .coefficient = coefficient };
+}
+
+// an empty (zero) polynomial sharing the variable layout of `like`
+static poly_t poly_zero_like(poly_t *like) {
+  poly_t p = { .allocator = like->allocator, .num_variables = like->num_variables };
+  memcpy(p.variables, like->variables, sizeof(p.variables));
+  return p;
+}
+
+void poly_free(poly_t *p) {
+  if (p->terms) p->allocator->dealloc((u8*)p->terms);
+  p->terms = NULL;
+  p->len = p->cap = 0;
+}
+
+static i32 poly_term_compare(const void *a, const void *b) {
+  monomial_t ma = ((const poly_term_t*)a)->monomial;
+  monomial_t mb = ((const poly_term_t*)b)->monomial;
+  return (ma < mb) - (ma > mb);
+}
+
+// sorts the terms into monomial order, merges like terms and drops zeros
+void poly_collect(poly_t *p) {
+  if (p->len == 0) return;
+
+  qsort(p->terms, p->len, sizeof(poly_term_t), poly_term_compare);
+
+  usize out = 0;
+  for (usize i = 0; i < p->len; i++) {
+    if ((out > 0) && (p->terms[out - 1].monomial == p->terms[i].monomial))
+      p->terms[out - 1].coefficient += p->terms[i].coefficient;
+    else
+      p->terms[out++] = p->terms[i];
+  }
+
+  usize nonzero = 0;
+  for (usize i = 0; i < out; i++)
+    if (p->terms[i].coefficient != 0.0) p->terms[nonzero++] = p->terms[i];
+
+  p->len = nonzero;
+}
+
+// merge of two sorted term lists, `sign` is applied to b (+1 sum, -1 difference)
+static poly_t poly_combine(poly_t *a, poly_t *b, f64 sign) {
+  poly_t r = poly_zero_like(a);
+  poly_reserve(&r, a->len + b->len);
+
+  usize i = 0, j = 0;
+  while ((i < a->len) && (j < b->len)) {
+    monomial_t ma = a->terms[i].monomial;
+    monomial_t mb = b->terms[j].monomial;
+
+    if (ma > mb) {
+      r.terms[r.len++] = a->terms[i++];
+    } else if (ma < mb) {
+      r.terms[r.len++] = (poly_term_t){ mb, sign * b->terms[j++].coefficient };
+    } else {
+      f64 c = a->terms[i++].coefficient + sign * b->terms[j++].coefficient;
+      if (c != 0.0) r.terms[r.len++] = (poly_term_t){ ma, c };
+    }
+  }
+
+  while (i < a->len) r.terms[r.len++] = a->terms[i++];
+  for (; j < b->len; j++) r.terms[r.len++] = (poly_term_t){ b->terms[j].monomial, sign * b->terms[j].coefficient };
+
+  return r;
+}
+
+poly_t poly_add(poly_t *a, poly_t *b) { return poly_combine(a, b, 1.0); }
+poly_t poly_sub(poly_t *a, poly_t *b) { return poly_combine(a, b, -1.0); }
+
+poly_t poly_negate(poly_t *a) {
+  poly_t r = poly_zero_like(a);
+  poly_reserve(&r, a->len);
+
+  for (usize i = 0; i < a->len; i++)
+    r.terms[r.len++] = (poly_term_t){ a->terms[i].monomial, -a->terms[i].coefficient };
+
+  return r;
+}
+
+typedef struct {
+  monomial_t monomial;
+  u32 i, j;
+} poly_heap_entry_t;
+
+static void poly_heap_sift_down(poly_heap_entry_t *heap, usize len, usize at) {
+  for (;;) {
+    usize largest = at;
+    usize l = 2 * at + 1, r = 2 * at + 2;
+
+    if ((l < len) && (heap[l].monomial > heap[largest].monomial)) largest = l;
+    if ((r < len) && (heap[r].monomial > heap[largest].monomial)) largest = r;
+    if (largest == at) return;
+
+    poly_heap_entry_t tmp = heap[at];
+    heap[at] = heap[largest];
+    heap[largest] = tmp;
+    at = largest;
+  }
+}
+
+static void poly_heap_sift_up(poly_heap_entry_t *heap, usize at) {
+  while (at > 0) {
+    usize parent = (at - 1) / 2;
+    if (heap[parent].monomial >= heap[at].monomial) return;
+
+    poly_heap_entry_t tmp = heap[at];
+    heap[at] = heap[parent];
+    heap[parent] = tmp;
+    at = parent;
+  }
+}
+
+// johnson's heap multiplication: one heap entry per term of the shorter
+// operand walks the longer one, so products come out already in order and
+// like terms are merged as they're popped. O(n m log(min(n, m))) time and
+// only O(min(n, m)) scratch.
+//
+// fails (returning false, `out` untouched) if some exponent of the product
+// would go past POLY_MAX_DEGREE.
+bool poly_mul(poly_t *out, poly_t *a, poly_t *b) {
+  if (a->len > b->len) { poly_t *t = a; a = b; b = t; }
+
+  poly_t r = poly_zero_like(a);
+  if ((a->len == 0) || (b->len == 0)) {
+    *out = r;
+    return true;
+  }
+
+  // the largest exponent of each variable in the product is the sum of the
+  // operands' largest ones, so one pass over each settles it up front
+  monomial_t degrees_a = 0, degrees_b = 0;
+  for (u8 v = 0; v < a->num_variables; v++) {
+    u8 da = 0, db = 0;
+    for (usize i = 0; i < a->len; i++) if (monomial_exponent(a->terms[i].monomial, v) > da) da = monomial_exponent(a->terms[i].monomial, v);
+    for (usize j = 0; j < b->len; j++) if (monomial_exponent(b->terms[j].monomial, v) > db) db = monomial_exponent(b->terms[j].monomial, v);
+    degrees_a |= monomial_of(v, da);
+    degrees_b |= monomial_of(v, db);
+  }
+
+  if (monomial_product_overflows(degrees_a, degrees_b)) return false;
+
+  poly_reserve(&r, a->len + b->len);
+
+  poly_heap_entry_t *heap = (poly_heap_entry_t*)a->allocator->alloc(sizeof(poly_heap_entry_t) * a->len);
+  usize heap_len = 0;
+
+  for (u32 i = 0; i < a->len; i++) {
+    heap[heap_len] = (poly_heap_entry_t){ a->terms[i].monomial + b->terms[0].monomial, i, 0 };
+    poly_heap_sift_up(heap, heap_len++);
+  }
+
+  while (heap_len > 0) {
+    poly_heap_entry_t top = heap[0];
+    f64 c = a->terms[top.i].coefficient * b->terms[top.j].coefficient;
+
+    if ((r.len > 0) && (r.terms[r.len - 1].monomial == top.monomial)) r.terms[r.len - 1].coefficient += c;
+    else {
+      if ((r.len > 0) && (r.terms[r.len - 1].coefficient == 0.0)) r.len--;
+      poly_push_term(&r, top.monomial, c);
+    }
+
+    if (top.j + 1 < b->len) {
+      heap[0] = (poly_heap_entry_t){ a->terms[top.i].monomial + b->terms[top.j + 1].monomial, top.i, top.j + 1 };
+    } else {
+      heap[0] = heap[--heap_len];
+    }
+
+    poly_heap_sift_down(heap, heap_len, 0);
+  }
+
+  if ((r.len > 0) && (r.terms[r.len - 1].coefficient == 0.0)) r.len--;
+
+  a->allocator->dealloc((u8*)heap);
+  *out = r;
+  return true;
+}
+
+// `a` to the `n`th power, by squaring. fails like poly_mul()
+bool poly_pow(poly_t *out, poly_t *a, u32 n) {
+  poly_t r = poly_zero_like(a);
+  poly_push_term(&r, 0, 1.0);
+
+  poly_t base = poly_zero_like(a);
+  poly_reserve(&base, a->len);
+  memcpy(base.terms, a->terms, sizeof(poly_term_t) * a->len);
+  base.len = a->len;
+
+  bool ok = true;
+
+  while (ok && (n > 0)) {
+    poly_t t;
+
+    if (n & 1) {
+      ok = poly_mul(&t, &r, &base);
+      if (ok) {
+        poly_free(&r);
+        r = t;
+      }
+    }
+
+    n >>= 1;
+    if (ok && (n > 0)) {
+      ok = poly_mul(&t, &base, &base);
+      if (ok) {
+        poly_free(&base);
+        base = t;
+      }
+    }
+  }
+
+  poly_free(&base);
+
+  if (!ok) {
+    poly_free(&r);
+    return false;
+  }
+
+  *out = r;
+  return true;
+}
+
+static bool is_nonnegative_integer_constant(expr_t *e) {
+  return (expr_variant(e) == EXPR_CONSTANT) &&
+    (expr_constant(e) >= 0.0) &&
+    (expr_constant(e) <= (f64)UINT32_MAX) &&
+    (expr_constant(e) == floor(expr_constant(e)));
+}
+
+bool is_polynomial_expr(expr_t *e) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT:
+    case EXPR_VARIABLE: { return true; }
+
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_PRODUCT: { return is_polynomial_expr(e->args.x) && is_polynomial_expr(e->args.y); }
+
+    case EXPR_POWER: { return is_nonnegative_integer_constant(e->args.y) && is_polynomial_expr(e->args.x); }
+
+    case EXPR_NEGATION: { return is_polynomial_expr(e->arg.x); }
+
+    case EXPR_QUOTIENT:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_INVERSE: { return false; }
+
+    default:
+      puts("is_polynomial_expr: corrupted/unhandled expression variant");
+      abort();
+  }
+}
+
+static i32 poly_variable_index(poly_t *p, char variable) {
+  for (u8 i = 0; i < p->num_variables; i++)
+    if (p->variables[i] == variable) return i;
+
+  return -1;
+}
+
+static bool poly_collect_variables(poly_t *p, expr_t *e) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT: { return true; }
+
+    case EXPR_VARIABLE: {
+      if (poly_variable_index(p, expr_variable(e)) >= 0) return true;
+      if (p->num_variables == POLY_MAX_VARIABLES) return false;
+
+      p->variables[p->num_variables++] = expr_variable(e);
+      return true;
+    }
+
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_PRODUCT:
+    case EXPR_POWER: { return poly_collect_variables(p, e->args.x) && poly_collect_variables(p, e->args.y); }
+
+    case EXPR_NEGATION: { return poly_collect_variables(p, e->arg.x); }
+
+    default: return false;
+  }
+}
+
+// fails only when a product or power overflows an exponent, which
+// poly_from_expr() rules out up front
+static bool poly_from_expr_rec(poly_t *out, poly_t *layout, expr_t *e) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT: {
+      *out = poly_zero_like(layout);
+      if (expr_constant(e) != 0.0) poly_push_term(out, 0, expr_constant(e));
+      return true;
+    }
+
+    case EXPR_VARIABLE: {
+      *out = poly_zero_like(layout);
+      poly_push_term(out, monomial_of((u8)poly_variable_index(layout, expr_variable(e)), 1), 1.0);
+      return true;
+    }
+
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE:
+    case EXPR_PRODUCT: {
+      poly_t x, y;
+      if (!poly_from_expr_rec(&x, layout, e->args.x)) return false;
+      if (!poly_from_expr_rec(&y, layout, e->args.y)) {
+        poly_free(&x);
+        return false;
+      }
+
+      bool ok = true;
+      if (expr_variant(e) == EXPR_SUM) *out = poly_add(&x, &y);
+      else if (expr_variant(e) == EXPR_DIFFERENCE) *out = poly_sub(&x, &y);
+      else ok = poly_mul(out, &x, &y);
+
+      poly_free(&x);
+      poly_free(&y);
+      return ok;
+    }
+
+    case EXPR_POWER: {
+      poly_t x;
+      if (!poly_from_expr_rec(&x, layout, e->args.x)) return false;
+      bool ok = poly_pow(out, &x, (u32)expr_constant(e->args.y));
+      poly_free(&x);
+      return ok;
+    }
+
+    case EXPR_NEGATION: {
+      poly_t x;
+      if (!poly_from_expr_rec(&x, layout, e->arg.x)) return false;
+      *out = poly_negate(&x);
+      poly_free(&x);
+      return true;
+    }
+
+    default:
+      puts("poly_from_expr: non-polynomial expression variant");
+      abort();
+  }
+}
+
+// upper bound on the degree of `e` in `variable`, saturating just past
+// POLY_MAX_DEGREE (it only has to tell whether the expansion fits)
+static u32 poly_degree_bound(expr_t *e, char variable) {
+  u32 bound;
+
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT: return 0;
+    case EXPR_VARIABLE: return expr_variable(e) == variable;
+
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE: {
+      u32 x = poly_degree_bound(e->args.x, variable), y = poly_degree_bound(e->args.y, variable);
+      bound = (x > y) ? x : y;
+      break;
+    }
+
+    case EXPR_PRODUCT: { bound = poly_degree_bound(e->args.x, variable) + poly_degree_bound(e->args.y, variable); break; }
+
+    case EXPR_POWER: {
+      u32 x = poly_degree_bound(e->args.x, variable);
+      f64 n = expr_constant(e->args.y);
+      bound = ((x > 0) && (n > POLY_MAX_DEGREE)) ? POLY_MAX_DEGREE + 1 : x * (u32)n;
+      break;
+    }
+
+    case EXPR_NEGATION: { bound = poly_degree_bound(e->arg.x, variable); break; }
+
+    default:
+      puts("poly_degree_bound: non-polynomial expression variant");
+      abort();
+  }
+
+  return (bound > POLY_MAX_DEGREE) ? POLY_MAX_DEGREE + 1 : bound;
+}
+
+// expands `e` into `out`. fails (returning false, `out` untouched) if `e`
+// isn't built from sums, differences, products, negations and non-negative
+// integer powers, uses more than POLY_MAX_VARIABLES variables, or could
+// reach a degree above POLY_MAX_DEGREE in any of them.
+bool poly_from_expr(poly_t *out, expr_t *e, allocator_t *allocator) {
+  if (!is_polynomial_expr(e)) return false;
+
+  poly_t layout = { .allocator = allocator };
+  if (!poly_collect_variables(&layout, e)) return false;
+
+  for (u8 v = 0; v < layout.num_variables; v++)
+    if (poly_degree_bound(e, layout.variables[v]) > POLY_MAX_DEGREE) return false;
+
+  return poly_from_expr_rec(out, &layout, e);
+}
+
+static expr_t *poly_term_to_expr(poly_t *p, poly_term_t *t, f64 coefficient, allocator_t *allocator) {
+  expr_t *term = NULL;
+
+  for (u8 v = 0; v < p->num_variables; v++) {
+    u8 k = monomial_exponent(t->monomial, v);
+    if (k == 0) continue;
+
+    expr_t *factor = alloc_leaf(allocator, Var(p->variables[v]));
+    if (k > 1) factor = alloc_expr(allocator, BinaryNode(EXPR_POWER, factor, alloc_leaf(allocator, Const(k))));
+
+    term = term ? alloc_expr(allocator, BinaryNode(EXPR_PRODUCT, term, factor)) : factor;
+  }
+
+  if (!term) return alloc_leaf(allocator, Const(coefficient));
+  if (coefficient == 1.0) return term;
+  if (coefficient == -1.0) return alloc_expr(allocator, UnaryNode(EXPR_NEGATION, term));
+
+  return alloc_expr(allocator, BinaryNode(EXPR_PRODUCT, alloc_leaf(allocator, Const(coefficient)), term));
+}
+
+// builds an expression tree owned entirely by `allocator` (release with
+// free_expr), with its leaves inline wherever they fit
+expr_t *poly_to_expr(poly_t *p, allocator_t *allocator) {
+  if (p->len == 0) return alloc_expr(allocator, Const(0));
+
+  expr_t *e = poly_term_to_expr(p, &p->terms[0], p->terms[0].coefficient, allocator);
+
+  for (usize i = 1; i < p->len; i++) {
+    f64 c = p->terms[i].coefficient;
+
+    if (c < 0.0) e = alloc_expr(allocator, BinaryNode(EXPR_DIFFERENCE, e, poly_term_to_expr(p, &p->terms[i], -c, allocator)));
+    else e = alloc_expr(allocator, BinaryNode(EXPR_SUM, e, poly_term_to_expr(p, &p->terms[i], c, allocator)));
+  }
+
+  // a lone constant or variable term came back as a child slot
+  if (expr_is_inline(e)) e = alloc_expr(allocator, expr_load(e));
+  return e;
+}
+
+static f64 poly_horner(poly_t *p, usize lo, usize hi, u8 v, const f64 *values) {
+  if (v == p->num_variables) return p->terms[lo].coefficient;
+
+  f64 x = values[v];
+  f64 acc = 0.0;
+  u8 prev = monomial_exponent(p->terms[lo].monomial, v);
+
+  // terms sharing an exponent in variable v are contiguous in lex order
+  usize i = lo;
+  while (i < hi) {
+    u8 k = monomial_exponent(p->terms[i].monomial, v);
+    usize j = i;
+    while ((j < hi) && (monomial_exponent(p->terms[j].monomial, v) == k)) j++;
+
+    acc = acc * pow(x, prev - k) + poly_horner(p, i, j, v + 1, values);
+    prev = k;
+    i = j;
+  }
+
+  return acc * pow(x, prev);
+}
+
+// nested horner evaluation. values[i] is the value of p->variables[i].
+f64 poly_evaluate(poly_t *p, const f64 *values) {
+  if (p->len == 0) return 0.0;
+  return poly_horner(p, 0, p->len, 0, values);
+}
+
+#endif
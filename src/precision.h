@@ -0,0 +1,294 @@
+#ifndef _LIBSEQ_PRECISION_H
+#define _LIBSEQ_PRECISION_H
+
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+#include "fastmath.h"
+#include "evaluate.h"
+
+// reduced precision batch evaluation
+//
+// EVALUATE_F32 stores inputs, constants and intermediates as f32 and runs
+// every node through f32 lanes (twice as many per register as f64).
+// EVALUATE_F16 stores them as f16 (half the memory again) and rounds
+// every node's result to f16; the arithmetic itself runs in f32 lanes and
+// is rounded once, which gives the same results as native f16 for
+// + - * / since f32 carries more than twice f16's precision.
+//
+// measured with make bench (fast kernels, 1M points): f32 runs ~1.6x the
+// f64 rate when the transcendental kernels dominate, and only matches f64
+// on a polynomial chain, where the f64 accumulator does most of the work.
+// f16 runs at 0.5-0.8x the f64 rate because every node converts to and
+// from f32. it saves memory, not time.
+//
+// chains of three or more sums and differences (expanded polynomials,
+// mostly) are accumulated in f64 and only rounded to the storage precision
+// once at the end of the chain, so cancellation between terms doesn't eat
+// the result. a lone a + b or a - b rounds once either way, so it is added
+// in the storage precision and skips the widening.
+
+typedef enum : u8 {
+  EVALUATE_F64,
+  EVALUATE_F32,
+  EVALUATE_F16
+} evaluate_precision_t;
+
+typedef struct {
+  const char *variables;
+  const f32 *const *values_f32;
+  const f16 *const *values_f16;
+  usize offset;
+  fastmath_accuracy_t accuracy;
+  evaluate_precision_t precision;
+
+  f32 *scratch;      // one EVALUATE_CHUNK buffer per tree level
+  f64 *accumulators; // likewise, for sum chains
+} evaluate_reduced_t;
+
+// straight from f64 to f16: going through f32 first rounds twice, and can
+// land on the other side of an f16 tie
+static inline f32 round_to_storage(evaluate_precision_t precision, f64 v) {
+  return (precision == EVALUATE_F16) ? (f32)(f16)v : (f32)v;
+}
+
+static void round_chunk_to_storage(evaluate_reduced_t *b, f32 *dst, usize len) {
+  if (b->precision != EVALUATE_F16) return;
+  for (usize i = 0; i < len; i++) dst[i] = (f32)(f16)dst[i];
+}
+
+static void evaluate_chunk_reduced(evaluate_reduced_t *b, expr_t *e, f32 *dst, usize len, usize level);
+
+static inline bool is_sum_link(expr_t *e) {
+  return (expr_variant(e) == EXPR_SUM) || (expr_variant(e) == EXPR_DIFFERENCE);
+}
+
+static void evaluate_sum_chain_reduced(evaluate_reduced_t *b, expr_t *e, f64 sign, f64 *acc, usize len, usize level) {
+  if (is_sum_link(e)) {
+    evaluate_sum_chain_reduced(b, e->args.x, sign, acc, len, level);
+    evaluate_sum_chain_reduced(b, e->args.y, (expr_variant(e) == EXPR_SUM) ? sign : -sign, acc, len, level);
+    return;
+  }
+
+  f32 *term = b->scratch + level * EVALUATE_CHUNK;
+  evaluate_chunk_reduced(b, e, term, len, level + 1);
+
+  for (usize i = 0; i < len; i++) acc[i] += sign * (f64)term[i];
+}
+
+static void evaluate_chunk_reduced(evaluate_reduced_t *b, expr_t *e, f32 *dst, usize len, usize level) {
+  switch (expr_variant(e)) {
+    case EXPR_CONSTANT: {
+      f32 c = round_to_storage(b->precision, expr_constant(e));
+      for (usize i = 0; i < len; i++) dst[i] = c;
+      return;
+    }
+
+    case EXPR_VARIABLE: {
+      usize index = evaluate_variable_index(b->variables, expr_variable(e));
+
+      if (b->precision == EVALUATE_F16) {
+        const f16 *src = b->values_f16[index] + b->offset;
+        for (usize i = 0; i < len; i++) dst[i] = (f32)src[i];
+      } else {
+        memcpy(dst, b->values_f32[index] + b->offset, sizeof(f32) * len);
+      }
+      return;
+    }
+
+    case EXPR_SUM:
+    case EXPR_DIFFERENCE: {
+      if (!is_sum_link(e->args.x) && !is_sum_link(e->args.y)) {
+        f32 *y = b->scratch + level * EVALUATE_CHUNK;
+
+        evaluate_chunk_reduced(b, e->args.x, dst, len, level + 1);
+        evaluate_chunk_reduced(b, e->args.y, y, len, level + 1);
+
+        if (expr_variant(e) == EXPR_SUM) for (usize i = 0; i < len; i++) dst[i] += y[i];
+        else for (usize i = 0; i < len; i++) dst[i] -= y[i];
+        break;
+      }
+
+      f64 *acc = b->accumulators + level * EVALUATE_CHUNK;
+      memset(acc, 0, sizeof(f64) * len);
+
+      evaluate_sum_chain_reduced(b, e, 1.0, acc, len, level);
+
+      for (usize i = 0; i < len; i++) dst[i] = round_to_storage(b->precision, acc[i]);
+      break;
+    }
+
+    case EXPR_PRODUCT:
+    case EXPR_QUOTIENT:
+    case EXPR_EXPONENTIAL:
+    case EXPR_LOGARITHM:
+    case EXPR_POWER: {
+      f32 *y = b->scratch + level * EVALUATE_CHUNK;
+
+      evaluate_chunk_reduced(b, e->args.x, dst, len, level + 1);
+      evaluate_chunk_reduced(b, e->args.y, y, len, level + 1);
+
+      switch (expr_variant(e)) {
+        case EXPR_PRODUCT: for (usize i = 0; i < len; i++) dst[i] *= y[i]; break;
+        case EXPR_QUOTIENT: for (usize i = 0; i < len; i++) dst[i] /= y[i]; break;
+
+        case EXPR_EXPONENTIAL:
+        case EXPR_POWER: fastmath_pow_f32(dst, dst, y, len, b->accuracy); break;
+
+        case EXPR_LOGARITHM: {
+          fastmath_log_f32(dst, dst, len, b->accuracy);
+          fastmath_log_f32(y, y, len, b->accuracy);
+          for (usize i = 0; i < len; i++) dst[i] = y[i] / dst[i];
+          break;
+        }
+
+        default: break;
+      }
+      break;
+    }
+
+    case EXPR_SIN:
+    case EXPR_COS:
+    case EXPR_TAN:
+    case EXPR_NEGATION:
+    case EXPR_INVERSE: {
+      evaluate_chunk_reduced(b, e->arg.x, dst, len, level + 1);
+
+      switch (expr_variant(e)) {
+        case EXPR_SIN: fastmath_sin_f32(dst, dst, len, b->accuracy); break;
+        case EXPR_COS: fastmath_cos_f32(dst, dst, len, b->accuracy); break;
+        case EXPR_TAN: fastmath_tan_f32(dst, dst, len, b->accuracy); break;
+        case EXPR_NEGATION: for (usize i = 0; i < len; i++) dst[i] = -dst[i]; break;
+        case EXPR_INVERSE: for (usize i = 0; i < len; i++) dst[i] = 1.0f / dst[i]; break;
+        default: break;
+      }
+      break;
+    }
+
+    default:
+      puts("evaluate_batch_reduced: corrupted/unhandled expression variant");
+      abort();
+  }
+
+  round_chunk_to_storage(b, dst, len);
+}
+
+static void evaluate_batch_reduced(evaluate_reduced_t *b, expr_t *e, f32 *out_f32, f16 *out_f16, usize n, allocator_t *allocator) {
+  usize height = expr_height(e);
+  b->scratch = (f32*)allocator->alloc(sizeof(f32) * EVALUATE_CHUNK * (height + 1));
+  b->accumulators = (f64*)allocator->alloc(sizeof(f64) * EVALUATE_CHUNK * height);
+
+  // f16 output goes through the spare top scratch level
+  f32 *staging = b->scratch + height * EVALUATE_CHUNK;
+
+  for (b->offset = 0; b->offset < n; b->offset += EVALUATE_CHUNK) {
+    usize len = (n - b->offset < EVALUATE_CHUNK) ? n - b->offset : EVALUATE_CHUNK;
+
+    if (out_f32) {
+      evaluate_chunk_reduced(b, e, out_f32 + b->offset, len, 0);
+    } else {
+      evaluate_chunk_reduced(b, e, staging, len, 0);
+      for (usize i = 0; i < len; i++) out_f16[b->offset + i] = (f16)staging[i];
+    }
+  }
+
+  allocator->dealloc((u8*)b->scratch);
+  allocator->dealloc((u8*)b->accumulators);
+}
+
+void evaluate_batch_f32(f32 *out, expr_t *e, const char *variables, const f32 *const *values, usize n,
+                        fastmath_accuracy_t accuracy, allocator_t *allocator) {
+  evaluate_reduced_t b = { .variables = variables, .values_f32 = values, .accuracy = accuracy, .precision = EVALUATE_F32 };
+  evaluate_batch_reduced(&b, e, out, NULL, n, allocator);
+}
+
+void evaluate_batch_f16(f16 *out, expr_t *e, const char *variables, const f16 *const *values, usize n,
+                        fastmath_accuracy_t accuracy, allocator_t *allocator) {
+  evaluate_reduced_t b = { .variables = variables, .values_f16 = values, .accuracy = accuracy, .precision = EVALUATE_F16 };
+  evaluate_batch_reduced(&b, e, NULL, out, n, allocator);
+}
+
+typedef struct {
+  f64 max_abs_error;
+  f64 max_rel_error;
+  f64 rms_rel_error;
+  usize worst_index; // point with the largest relative error
+  usize compared;    // points where the f64 result was finite and nonzero
+} precision_error_t;
+
+// evaluates `e` at `precision` (inputs rounded to it) and compares against
+// the f64 result at the original inputs, to check whether a tolerance
+// allows the cheaper mode before committing a sweep to it
+precision_error_t evaluate_precision_error(expr_t *e, const char *variables, const f64 *const *values, usize n,
+                                           evaluate_precision_t precision, fastmath_accuracy_t accuracy,
+                                           allocator_t *allocator) {
+  usize num_variables = variables ? strlen(variables) : 0;
+
+  f64 *reference = (f64*)allocator->alloc(sizeof(f64) * n);
+  f64 *reduced = (f64*)allocator->alloc(sizeof(f64) * n);
+
+  evaluate_batch(reference, e, variables, values, n, FASTMATH_STRICT, allocator);
+
+  if (precision == EVALUATE_F64) {
+    evaluate_batch(reduced, e, variables, values, n, accuracy, allocator);
+  } else {
+    usize element = (precision == EVALUATE_F16) ? sizeof(f16) : sizeof(f32);
+    u8 **inputs = (u8**)allocator->alloc(sizeof(u8*) * (num_variables + 1));
+    u8 *output = allocator->alloc(element * n);
+
+    for (usize v = 0; v < num_variables; v++) {
+      inputs[v] = allocator->alloc(element * n);
+
+      for (usize i = 0; i < n; i++) {
+        if (precision == EVALUATE_F16) ((f16*)inputs[v])[i] = (f16)values[v][i];
+        else ((f32*)inputs[v])[i] = (f32)values[v][i];
+      }
+    }
+
+    if (precision == EVALUATE_F16) {
+      evaluate_batch_f16((f16*)output, e, variables, (const f16 *const *)inputs, n, accuracy, allocator);
+      for (usize i = 0; i < n; i++) reduced[i] = (f64)((f16*)output)[i];
+    } else {
+      evaluate_batch_f32((f32*)output, e, variables, (const f32 *const *)inputs, n, accuracy, allocator);
+      for (usize i = 0; i < n; i++) reduced[i] = (f64)((f32*)output)[i];
+    }
+
+    for (usize v = 0; v < num_variables; v++) allocator->dealloc(inputs[v]);
+    allocator->dealloc((u8*)inputs);
+    allocator->dealloc(output);
+  }
+
+  precision_error_t err = {};
+  f64 sum_squares = 0.0;
+
+  for (usize i = 0; i < n; i++) {
+    if (!isfinite(reference[i]) || (reference[i] == 0.0)) continue;
+
+    f64 abs_error = fabs(reduced[i] - reference[i]);
+    if (isnan(abs_error)) abs_error = INFINITY;
+    f64 rel_error = abs_error / fabs(reference[i]);
+
+    if (abs_error > err.max_abs_error) err.max_abs_error = abs_error;
+    if (rel_error > err.max_rel_error) {
+      err.max_rel_error = rel_error;
+      err.worst_index = i;
+    }
+
+    sum_squares += rel_error * rel_error;
+    err.compared++;
+  }
+
+  if (err.compared > 0) err.rms_rel_error = sqrt(sum_squares / (f64)err.compared);
+
+  allocator->dealloc((u8*)reference);
+  allocator->dealloc((u8*)reduced);
+  return err;
+}
+
+#endif
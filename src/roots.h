@@ -0,0 +1,151 @@
+#ifndef _LIBSEQ_ROOTS_H
+#define _LIBSEQ_ROOTS_H
+
+#include <stdbool.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+#include "fastmath.h"
+#include "evaluate.h"
+#include "derivative.h"
+
+// batched newton/halley root finding
+//
+// f' (and f'' for halley) are derived once from the expression, then the
+// starting points are iterated ROOT_BLOCK at a time: every round evaluates
+// f, f' (and f'') for all of a block's live points with evaluate_batch(),
+// takes the step in one flat loop and compacts the points that converged
+// or diverged out of the block, so later rounds only pay for the points
+// still running and no point ever walks the tree on its own.
+//
+// all points of a block start together, so a point retiring in round k took
+// k iterations.
+
+#define ROOT_BLOCK 4096
+
+typedef enum : u8 {
+  ROOT_NEWTON,
+  ROOT_HALLEY
+} root_method_t;
+
+typedef enum : u8 {
+  ROOT_CONVERGED,
+  ROOT_DIVERGED,      // went non-finite, or f' (halley: the denominator) hit 0
+  ROOT_MAX_ITERATIONS
+} root_status_t;
+
+typedef struct {
+  root_method_t method;
+  f64 tolerance;      // converged once |step| <= tolerance * max(1, |x|)
+  u32 max_iterations;
+  fastmath_accuracy_t accuracy;
+} root_options_t;
+
+typedef struct {
+  expr_t *f, *df, *d2f;
+  char variables[2];
+  root_options_t options;
+  allocator_t *allocator;
+
+  f64 *x, *fx, *d1, *d2, *step;
+  usize *index;
+} root_solver_t;
+
+static void root_retire(f64 *roots, u32 *iterations, root_status_t *status, usize index, f64 x, u32 round, root_status_t s) {
+  roots[index] = x;
+  if (iterations) iterations[index] = round;
+  if (status) status[index] = s;
+}
+
+static void root_solve_block(root_solver_t *r, f64 *roots, u32 *iterations, root_status_t *status,
+                             const f64 *starts, usize offset, usize len) {
+  usize live = len;
+
+  for (usize i = 0; i < len; i++) {
+    r->x[i] = starts[offset + i];
+    r->index[i] = offset + i;
+  }
+
+  for (u32 round = 1; (live > 0) && (round <= r->options.max_iterations); round++) {
+    const f64 *values[] = { r->x };
+
+    evaluate_batch(r->fx, r->f, r->variables, values, live, r->options.accuracy, r->allocator);
+    evaluate_batch(r->d1, r->df, r->variables, values, live, r->options.accuracy, r->allocator);
+
+    if (r->options.method == ROOT_HALLEY) {
+      evaluate_batch(r->d2, r->d2f, r->variables, values, live, r->options.accuracy, r->allocator);
+
+      for (usize i = 0; i < live; i++) {
+        f64 fx = r->fx[i], d1 = r->d1[i];
+        r->step[i] = ((f64)2.0 * fx * d1) / ((f64)2.0 * d1 * d1 - fx * r->d2[i]);
+      }
+    } else {
+      for (usize i = 0; i < live; i++) r->step[i] = r->fx[i] / r->d1[i];
+    }
+
+    usize kept = 0;
+
+    for (usize i = 0; i < live; i++) {
+      f64 x = r->x[i];
+      f64 next = x - r->step[i];
+
+      if (r->fx[i] == 0.0) {
+        root_retire(roots, iterations, status, r->index[i], x, round, ROOT_CONVERGED);
+      } else if (!isfinite(next)) {
+        root_retire(roots, iterations, status, r->index[i], next, round, ROOT_DIVERGED);
+      } else if (fabs(next - x) <= r->options.tolerance * fmax(1.0, fabs(next))) {
+        root_retire(roots, iterations, status, r->index[i], next, round, ROOT_CONVERGED);
+      } else {
+        r->x[kept] = next;
+        r->index[kept] = r->index[i];
+        kept++;
+      }
+    }
+
+    live = kept;
+  }
+
+  for (usize i = 0; i < live; i++)
+    root_retire(roots, iterations, status, r->index[i], r->x[i], r->options.max_iterations, ROOT_MAX_ITERATIONS);
+}
+
+// solves f(variable) = 0 from each of starts[0..n). roots[i] is where the
+// iteration from starts[i] stopped, iterations[i] how many steps it took
+// and status[i] why it stopped (iterations and status may be NULL). `f`
+// may only use `variable`
+void find_roots(f64 *roots, u32 *iterations, root_status_t *status, expr_t *f, char variable,
+                const f64 *starts, usize n, root_options_t options, allocator_t *allocator) {
+  root_solver_t r = {
+    .f = f,
+    .df = differentiate(f, variable, allocator),
+    .variables = { variable, '\0' },
+    .options = options,
+    .allocator = allocator,
+  };
+
+  if (options.method == ROOT_HALLEY) r.d2f = differentiate(r.df, variable, allocator);
+
+  usize block = (n < ROOT_BLOCK) ? n : ROOT_BLOCK;
+  r.x = (f64*)allocator->alloc(sizeof(f64) * block * 5);
+  r.fx = r.x + block;
+  r.d1 = r.fx + block;
+  r.d2 = r.d1 + block;
+  r.step = r.d2 + block;
+  r.index = (usize*)allocator->alloc(sizeof(usize) * block);
+
+  for (usize offset = 0; offset < n; offset += ROOT_BLOCK) {
+    usize len = (n - offset < ROOT_BLOCK) ? n - offset : ROOT_BLOCK;
+    root_solve_block(&r, roots, iterations, status, starts, offset, len);
+  }
+
+  allocator->dealloc((u8*)r.x);
+  allocator->dealloc((u8*)r.index);
+  free_expr(allocator, r.df);
+  if (r.d2f) free_expr(allocator, r.d2f);
+}
+
+#endif
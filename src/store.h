@@ -0,0 +1,198 @@
+#ifndef _LIBSEQ_STORE_H
+#define _LIBSEQ_STORE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "primitives.h"
+#include "allocator.h"
+#include "expressions.h"
+#include "canonical.h"
+
+// on-disk set of canonical expressions
+//
+// the file is a header followed by an open addressed (linear probing)
+// table of 128 bit fingerprints, mmap'd so lookups touch one or two cache
+// lines and never read the rest of the file. only fingerprints are kept,
+// not the trees: two different expressions colliding on all 128 bits is
+// what makes a false "seen before", which at a few million entries is
+// around 2^-85 likely. the table doubles once it is 3/4 full.
+//
+// growing rehashes into "<path>.grow", syncs it and rename()s it over the
+// store, so a crash mid-grow leaves the old table intact (plus a stray
+// .grow file the next grow truncates). inserts between grows go straight
+// into the shared mapping and are only as durable as the page cache.
+
+#define EXPR_STORE_MAGIC 0x313051455342494CULL // "LIBSEQ01"
+#define EXPR_STORE_MIN_CAPACITY 1024
+
+typedef struct {
+  u64 magic;
+  u64 capacity; // power of two
+  u64 count;
+  u64 reserved;
+} expr_store_header_t;
+
+typedef struct {
+  i32 fd;
+  char *path;
+  expr_store_header_t *header;
+  expr_fingerprint_t *slots; // {0, 0} is an empty slot
+  usize mapped_size;
+  allocator_t *allocator;
+} expr_store_t;
+
+static usize expr_store_file_size(u64 capacity) {
+  return sizeof(expr_store_header_t) + sizeof(expr_fingerprint_t) * capacity;
+}
+
+static bool expr_store_map(expr_store_t *store, u64 capacity) {
+  usize size = expr_store_file_size(capacity);
+  if (ftruncate(store->fd, (off_t)size) != 0) return false;
+
+  u8 *map = (u8*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, store->fd, 0);
+  if (map == MAP_FAILED) return false;
+
+  store->header = (expr_store_header_t*)map;
+  store->slots = (expr_fingerprint_t*)(map + sizeof(expr_store_header_t));
+  store->mapped_size = size;
+  return true;
+}
+
+static inline expr_fingerprint_t expr_store_key(expr_t *e) {
+  expr_fingerprint_t f = expr_fingerprint(e);
+  f.hi |= 1; // never the empty slot
+  return f;
+}
+
+// index of `key`'s slot, or of the empty slot where it would go
+static usize expr_store_probe(expr_fingerprint_t *slots, u64 capacity, expr_fingerprint_t key) {
+  usize mask = capacity - 1;
+  usize slot = key.lo & mask;
+
+  while (slots[slot].hi != 0) {
+    if ((slots[slot].hi == key.hi) && (slots[slot].lo == key.lo)) break;
+    slot = (slot + 1) & mask;
+  }
+
+  return slot;
+}
+
+static bool expr_store_grow(expr_store_t *store) {
+  u64 capacity = store->header->capacity * 2;
+  usize path_len = strlen(store->path);
+
+  char *grow_path = (char*)store->allocator->alloc(path_len + sizeof(".grow"));
+  memcpy(grow_path, store->path, path_len);
+  memcpy(grow_path + path_len, ".grow", sizeof(".grow"));
+
+  expr_store_t grown = { .fd = open(grow_path, O_RDWR | O_CREAT | O_TRUNC, 0644) };
+  bool ok = (grown.fd >= 0) && expr_store_map(&grown, capacity);
+
+  if (ok) {
+    for (u64 i = 0; i < store->header->capacity; i++) {
+      if (store->slots[i].hi == 0) continue;
+      grown.slots[expr_store_probe(grown.slots, capacity, store->slots[i])] = store->slots[i];
+    }
+
+    *grown.header = (expr_store_header_t){ .magic = EXPR_STORE_MAGIC, .capacity = capacity, .count = store->header->count };
+    ok = (msync(grown.header, grown.mapped_size, MS_SYNC) == 0) && (rename(grow_path, store->path) == 0);
+  }
+
+  if (!ok) {
+    if (grown.header) munmap(grown.header, grown.mapped_size);
+    if (grown.fd >= 0) {
+      close(grown.fd);
+      unlink(grow_path);
+    }
+    store->allocator->dealloc((u8*)grow_path);
+    return false;
+  }
+
+  munmap(store->header, store->mapped_size);
+  close(store->fd);
+
+  store->fd = grown.fd;
+  store->header = grown.header;
+  store->slots = grown.slots;
+  store->mapped_size = grown.mapped_size;
+
+  store->allocator->dealloc((u8*)grow_path);
+  return true;
+}
+
+// opens (or creates) the store at `path`. fails if the file exists but
+// isn't a store
+bool expr_store_open(expr_store_t *store, const char *path, allocator_t *allocator) {
+  *store = (expr_store_t){ .fd = open(path, O_RDWR | O_CREAT, 0644), .allocator = allocator };
+  if (store->fd < 0) return false;
+
+  usize path_size = strlen(path) + 1;
+  store->path = (char*)allocator->alloc(path_size);
+  memcpy(store->path, path, path_size);
+
+  off_t size = lseek(store->fd, 0, SEEK_END);
+
+  if (size == 0) {
+    if (!expr_store_map(store, EXPR_STORE_MIN_CAPACITY)) goto fail;
+    *store->header = (expr_store_header_t){ .magic = EXPR_STORE_MAGIC, .capacity = EXPR_STORE_MIN_CAPACITY };
+    return true;
+  }
+
+  expr_store_header_t header;
+  if ((size < (off_t)sizeof(header)) || (pread(store->fd, &header, sizeof(header), 0) != (isize)sizeof(header))) goto fail;
+
+  bool valid = (header.magic == EXPR_STORE_MAGIC) && (header.capacity >= EXPR_STORE_MIN_CAPACITY)
+    && ((header.capacity & (header.capacity - 1)) == 0) && ((usize)size == expr_store_file_size(header.capacity));
+  if (!valid || !expr_store_map(store, header.capacity)) goto fail;
+
+  return true;
+
+fail:
+  close(store->fd);
+  allocator->dealloc((u8*)store->path);
+  *store = (expr_store_t){ .fd = -1 };
+  return false;
+}
+
+void expr_store_close(expr_store_t *store) {
+  if (store->header) munmap(store->header, store->mapped_size);
+  if (store->fd >= 0) close(store->fd);
+  if (store->path) store->allocator->dealloc((u8*)store->path);
+  *store = (expr_store_t){ .fd = -1 };
+}
+
+usize expr_store_count(expr_store_t *store) {
+  return store->header->count;
+}
+
+// `e` should be canonical (see canonicalize_expr())
+bool expr_store_contains(expr_store_t *store, expr_t *e) {
+  expr_fingerprint_t key = expr_store_key(e);
+  return store->slots[expr_store_probe(store->slots, store->header->capacity, key)].hi != 0;
+}
+
+// adds `e` (canonical) to the store, returns whether it was seen before
+bool expr_store_insert(expr_store_t *store, expr_t *e) {
+  expr_fingerprint_t key = expr_store_key(e);
+  usize slot = expr_store_probe(store->slots, store->header->capacity, key);
+
+  if (store->slots[slot].hi != 0) return true;
+
+  store->slots[slot] = key;
+  store->header->count++;
+
+  if ((store->header->count * 4 >= store->header->capacity * 3) && !expr_store_grow(store)) {
+    puts("expr_store_insert: failed to grow the store");
+    abort();
+  }
+
+  return false;
+}
+
+#endif
@@ -0,0 +1,254 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/expressions.h"
+#include "../src/allocator.h"
+#include "../src/fastmath.h"
+#include "../src/evaluate.h"
+#include "../src/precision.h"
+#include "../src/derivative.h"
+#include "../src/roots.h"
+#include "../src/integrate.h"
+
+// ANSI color codes
+#define COLOR_RESET   "\033[0m"
+#define COLOR_YELLOW  "\033[33m"
+#define COLOR_BOLD    "\033[1m"
+#define COLOR_BLUE    "\033[34m"
+
+#define BENCH_N (1 << 20)
+#define BENCH_REPEATS 10
+
+static const char *accuracy_names[] = { "strict", "ulp1", "fast" };
+static const char *op_names[] = { "sin", "cos", "tan", "exp", "log", "pow" };
+
+static f64 now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (f64)ts.tv_sec + (f64)ts.tv_nsec * 1e-9;
+}
+
+// keeps the compiler from discarding results
+static volatile f64 sink;
+
+void bench_fastmath(f64 *x, f64 *y, f64 *out, f32 *x32, f32 *y32, f32 *out32) {
+    printf("%s=== fastmath kernels (Melem/s, %d elements) ===%s\n", COLOR_YELLOW, BENCH_N, COLOR_RESET);
+    printf("%-6s %10s %10s %10s | %10s %10s %10s\n", "", "f64 strict", "f64 ulp1", "f64 fast", "f32 strict", "f32 ulp1", "f32 fast");
+
+    for (fastmath_op_t op = FASTMATH_OP_SIN; op <= FASTMATH_OP_POW; op++) {
+        printf("%-6s", op_names[op]);
+
+        for (fastmath_accuracy_t accuracy = FASTMATH_STRICT; accuracy <= FASTMATH_FAST; accuracy++) {
+            f64 start = now();
+            for (usize r = 0; r < BENCH_REPEATS; r++)
+                fastmath_map_f64(op, out, x, (op == FASTMATH_OP_POW) ? y : NULL, BENCH_N, accuracy);
+            f64 elapsed = now() - start;
+            sink = out[BENCH_N / 2];
+
+            printf(" %10.1f", (f64)BENCH_N * BENCH_REPEATS / elapsed * 1e-6);
+        }
+
+        printf(" |");
+
+        for (fastmath_accuracy_t accuracy = FASTMATH_STRICT; accuracy <= FASTMATH_FAST; accuracy++) {
+            f64 start = now();
+            for (usize r = 0; r < BENCH_REPEATS; r++)
+                fastmath_map_f32(op, out32, x32, (op == FASTMATH_OP_POW) ? y32 : NULL, BENCH_N, accuracy);
+            f64 elapsed = now() - start;
+            sink = out32[BENCH_N / 2];
+
+            printf(" %10.1f", (f64)BENCH_N * BENCH_REPEATS / elapsed * 1e-6);
+        }
+
+        printf("\n");
+    }
+
+    printf("\n");
+}
+
+void bench_evaluate(f64 *x, f64 *y, f64 *out) {
+    printf("%s=== evaluate vs evaluate_batch (Mpoints/s) ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    expr_t e = Sum(&Product(&Sin(&Var('x')), &Power(&Var('y'), &Const(3))),
+        &Quotient(&Logarithm(&Const(2), &Var('x')), &Sum(&Exponential(&Var('x'), &Var('y')), &Cos(&Var('y')))));
+
+    f64 start = now();
+    for (usize i = 0; i < BENCH_N; i++) {
+        f64 point[] = { x[i], y[i] };
+        out[i] = evaluate(&e, "xy", point);
+    }
+    f64 elapsed = now() - start;
+    sink = out[BENCH_N / 2];
+    printf("%-24s %10.1f\n", "evaluate (scalar)", (f64)BENCH_N / elapsed * 1e-6);
+
+    // same tree with its leaves held inline in the child slots
+    expr_t e_inline = Sum(&Product(&Sin(VarLeaf('x')), &Power(VarLeaf('y'), ConstLeaf(3))),
+        &Quotient(&Logarithm(ConstLeaf(2), VarLeaf('x')), &Sum(&Exponential(VarLeaf('x'), VarLeaf('y')), &Cos(VarLeaf('y')))));
+
+    start = now();
+    for (usize i = 0; i < BENCH_N; i++) {
+        f64 point[] = { x[i], y[i] };
+        out[i] = evaluate(&e_inline, "xy", point);
+    }
+    elapsed = now() - start;
+    sink = out[BENCH_N / 2];
+    printf("%-24s %10.1f\n", "evaluate (inline leaves)", (f64)BENCH_N / elapsed * 1e-6);
+
+    const f64 *values[] = { x, y };
+    for (fastmath_accuracy_t accuracy = FASTMATH_STRICT; accuracy <= FASTMATH_FAST; accuracy++) {
+        start = now();
+        evaluate_batch(out, &e, "xy", values, BENCH_N, accuracy, &gpa_allocator);
+        elapsed = now() - start;
+        sink = out[BENCH_N / 2];
+
+        char label[32];
+        snprintf(label, sizeof(label), "evaluate_batch %s", accuracy_names[accuracy]);
+        printf("%-24s %10.1f\n", label, (f64)BENCH_N / elapsed * 1e-6);
+    }
+
+    printf("\n");
+}
+
+void bench_precision(f64 *x, f64 *y, f32 *x32, f32 *y32, f32 *out32) {
+    printf("%s=== evaluate_batch by precision, fast kernels (Mpoints/s) ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    // a lone a + b, and a four term chain that takes the f64 accumulator
+    expr_t mixed = Sum(&Product(&Sin(&Var('x')), &Power(&Var('y'), &Const(3))), &Product(&Const(0.5), &Exponential(&Var('x'), &Var('y'))));
+    expr_t chain = Difference(&Sum(&Sum(&Product(&Var('x'), &Var('y')), &Power(&Var('x'), &Const(2))), &Product(&Const(0.5), &Var('y'))), &Const(1));
+
+    f64 *out GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * BENCH_N);
+    f16 *x16 GPA_DEALLOC = (f16*)gpa_allocator.alloc(sizeof(f16) * BENCH_N);
+    f16 *y16 GPA_DEALLOC = (f16*)gpa_allocator.alloc(sizeof(f16) * BENCH_N);
+    f16 *out16 GPA_DEALLOC = (f16*)gpa_allocator.alloc(sizeof(f16) * BENCH_N);
+
+    for (usize i = 0; i < BENCH_N; i++) {
+        x16[i] = (f16)x[i];
+        y16[i] = (f16)y[i];
+    }
+
+    const f64 *values[] = { x, y };
+    const f32 *values32[] = { x32, y32 };
+    const f16 *values16[] = { x16, y16 };
+    f64 rates[3][2];
+
+    for (usize k = 0; k < 2; k++) {
+        expr_t *e = (k == 0) ? &mixed : &chain;
+
+        f64 start = now();
+        evaluate_batch(out, e, "xy", values, BENCH_N, FASTMATH_FAST, &gpa_allocator);
+        rates[0][k] = (f64)BENCH_N / (now() - start) * 1e-6;
+
+        start = now();
+        evaluate_batch_f32(out32, e, "xy", values32, BENCH_N, FASTMATH_FAST, &gpa_allocator);
+        rates[1][k] = (f64)BENCH_N / (now() - start) * 1e-6;
+
+        start = now();
+        evaluate_batch_f16(out16, e, "xy", values16, BENCH_N, FASTMATH_FAST, &gpa_allocator);
+        rates[2][k] = (f64)BENCH_N / (now() - start) * 1e-6;
+    }
+
+    printf("%-24s %10s %10s\n", "", "a + b", "4 terms");
+    printf("%-24s %10.1f %10.1f\n", "f64", rates[0][0], rates[0][1]);
+    printf("%-24s %10.1f %10.1f\n", "f32", rates[1][0], rates[1][1]);
+    printf("%-24s %10.1f %10.1f\n", "f16", rates[2][0], rates[2][1]);
+
+    sink = out[BENCH_N / 2] + out32[BENCH_N / 2] + (f64)out16[BENCH_N / 2];
+    printf("\n");
+}
+
+void bench_roots(f64 *x, f64 *out) {
+    printf("%s=== root finding on x^3 - 2x - 5 (Mpoints/s) ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    expr_t e = Difference(&Difference(&Power(&Var('x'), &Const(3)), &Product(&Const(2), &Var('x'))), &Const(5));
+    expr_t *de = differentiate(&e, 'x', &gpa_allocator);
+
+    // newton driven from outside, one tree walk per point per iteration
+    f64 start = now();
+    for (usize i = 0; i < BENCH_N; i++) {
+        f64 point[] = { x[i] };
+        for (u32 k = 0; k < 100; k++) {
+            f64 step = evaluate(&e, "x", point) / evaluate(de, "x", point);
+            point[0] -= step;
+            if (!isfinite(point[0]) || (fabs(step) <= 1e-12 * fmax(1.0, fabs(point[0])))) break;
+        }
+        out[i] = point[0];
+    }
+    f64 elapsed = now() - start;
+    sink = out[BENCH_N / 2];
+    printf("%-24s %10.1f\n", "newton (scalar)", (f64)BENCH_N / elapsed * 1e-6);
+
+    free_expr(&gpa_allocator, de);
+
+    for (root_method_t method = ROOT_NEWTON; method <= ROOT_HALLEY; method++) {
+        root_options_t options = { .method = method, .tolerance = 1e-12, .max_iterations = 100, .accuracy = FASTMATH_FAST };
+
+        start = now();
+        find_roots(out, NULL, NULL, &e, 'x', x, BENCH_N, options, &gpa_allocator);
+        elapsed = now() - start;
+        sink = out[BENCH_N / 2];
+        printf("%-24s %10.1f\n", (method == ROOT_NEWTON) ? "find_roots newton" : "find_roots halley", (f64)BENCH_N / elapsed * 1e-6);
+    }
+
+    printf("\n");
+}
+
+void bench_integrate() {
+    printf("%s=== adaptive integration (ms per integral) ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    expr_t oscillating = Product(&Sin(&Product(&Const(50), &Var('x'))), &Exponential(&Const(M_E), &Negation(&Var('x'))));
+    expr_t surface = Inverse(&Sum(&Sum(&Const(1), &Power(&Var('x'), &Const(2))), &Power(&Var('y'), &Const(2))));
+    f64 lower[] = { 0.0, 0.0 }, upper[] = { 40.0, 1.0 }, unit[] = { 1.0, 1.0 };
+
+    for (u32 threads = 1; threads <= 2; threads++) {
+        integrate_options_t options = INTEGRATE_DEFAULTS;
+        options.threads = (threads == 1) ? 1 : 0;
+        const char *suffix = (threads == 1) ? "1 thread" : "all cpus";
+        char label[48];
+
+        f64 start = now();
+        integral_t result = integrate_with(&oscillating, "x", lower, upper, 1e-12, options, &gpa_allocator);
+        f64 elapsed = now() - start;
+        sink = result.value;
+        snprintf(label, sizeof(label), "1d, %s", suffix);
+        printf("%-24s %10.3f  (%zu regions)\n", label, elapsed * 1e3, result.regions);
+
+        start = now();
+        result = integrate_with(&surface, "xy", lower, unit, 1e-11, options, &gpa_allocator);
+        elapsed = now() - start;
+        sink = result.value;
+        snprintf(label, sizeof(label), "2d, %s", suffix);
+        printf("%-24s %10.3f  (%zu regions)\n", label, elapsed * 1e3, result.regions);
+    }
+
+    printf("\n");
+}
+
+int main() {
+    printf("%s=== LIBSEQ THROUGHPUT BENCHMARKS ===%s\n\n", COLOR_BOLD COLOR_BLUE, COLOR_RESET);
+
+    f64 *x GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * BENCH_N);
+    f64 *y GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * BENCH_N);
+    f64 *out GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * BENCH_N);
+    f32 *x32 GPA_DEALLOC = (f32*)gpa_allocator.alloc(sizeof(f32) * BENCH_N);
+    f32 *y32 GPA_DEALLOC = (f32*)gpa_allocator.alloc(sizeof(f32) * BENCH_N);
+    f32 *out32 GPA_DEALLOC = (f32*)gpa_allocator.alloc(sizeof(f32) * BENCH_N);
+
+    // positive arguments keep log and pow on their fast paths
+    for (usize i = 0; i < BENCH_N; i++) {
+        x[i] = 0.01 + 20.0 * (f64)i / BENCH_N;
+        y[i] = -4.0 + 8.0 * (f64)((i * 7919) % BENCH_N) / BENCH_N;
+        x32[i] = (f32)x[i];
+        y32[i] = (f32)y[i];
+    }
+
+    bench_fastmath(x, y, out, x32, y32, out32);
+    bench_evaluate(x, y, out);
+    bench_precision(x, y, x32, y32, out32);
+    bench_roots(x, out);
+    bench_integrate();
+
+    return 0;
+}
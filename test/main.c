@@ -3,9 +3,22 @@
 #include <math.h>
 #include <string.h>
 #include <assert.h>
+#include <float.h>
+#include <pthread.h>
+#include <dlfcn.h>
 
 #include "../src/expressions.h"
 #include "../src/allocator.h"
+#include "../src/polynomial.h"
+#include "../src/codegen.h"
+#include "../src/fastmath.h"
+#include "../src/evaluate.h"
+#include "../src/precision.h"
+#include "../src/canonical.h"
+#include "../src/store.h"
+#include "../src/derivative.h"
+#include "../src/roots.h"
+#include "../src/integrate.h"
 
 // ANSI color codes
 #define COLOR_RESET   "\033[0m"
@@ -74,6 +87,724 @@ void test_expression(const char* test_name, expr_t expr, const char* expected_se
     printf("\n");
 }
 
+// Helper function to test polynomial expansion, round-tripping and horner evaluation
+void test_polynomial(const char* test_name, expr_t expr, const char* expected_serialization, const f64 *values, double expected_value) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    poly_t p;
+    if (!poly_from_expr(&p, &expr, &gpa_allocator)) {
+        printf("%s✗ Not recognized as a polynomial%s\n\n", COLOR_RED, COLOR_RESET);
+        return;
+    }
+
+    expr_t *expanded = poly_to_expr(&p, &gpa_allocator);
+    usize size = serialized_expr_size(expanded);
+    char *buffer GPA_DEALLOC = (char*)gpa_allocator.alloc(sizeof(char) * (size + 1));
+    buffer[size] = '\0';
+    serialize_expr(buffer, expanded);
+    printf("Expanded: %s (%zu terms)\n", buffer, p.len);
+
+    bool test_passed = true;
+
+    if (expected_serialization && strcmp(buffer, expected_serialization) != 0) {
+        printf("%s✗ Expected: %s, Got: %s%s\n", COLOR_RED, expected_serialization, buffer, COLOR_RESET);
+        test_passed = false;
+    }
+
+    if (expr_is_inline(expanded)) {
+        printf("%s✗ Root came back as an inline leaf%s\n", COLOR_RED, COLOR_RESET);
+        test_passed = false;
+    }
+
+    double value = poly_evaluate(&p, values);
+    double diff = fabs(value - expected_value);
+    if (diff < 1e-9 * fmax(1.0, fabs(expected_value))) {
+        printf("%s✓ Horner value matches expected: %.6f%s\n", COLOR_GREEN, expected_value, COLOR_RESET);
+    } else {
+        printf("%s✗ Expected value: %.6f, Got: %.6f (diff: %e)%s\n",
+               COLOR_RED, expected_value, value, diff, COLOR_RESET);
+        test_passed = false;
+    }
+
+    free_expr(&gpa_allocator, expanded);
+    poly_free(&p);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+
+    printf("\n");
+}
+
+// Helper function to test C code generation by inspecting the emitted source
+void test_codegen(const char* test_name, expr_t expr, const char* variables, const char* must_contain, usize expected_occurrences) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    char *source = NULL;
+    usize source_size = 0;
+    FILE *out = open_memstream(&source, &source_size);
+
+    bool generated = codegen_c(out, &expr, "generated_fn", variables, &gpa_allocator);
+    fclose(out);
+
+    bool test_passed = generated;
+
+    if (!generated) {
+        printf("%s✗ Code generation failed%s\n", COLOR_RED, COLOR_RESET);
+    } else {
+        printf("%s", source);
+
+        usize occurrences = 0;
+        for (char *at = strstr(source, must_contain); at; at = strstr(at + 1, must_contain)) occurrences++;
+
+        if (occurrences == expected_occurrences) {
+            printf("%s✓ '%s' emitted %zu time(s)%s\n", COLOR_GREEN, must_contain, occurrences, COLOR_RESET);
+        } else {
+            printf("%s✗ Expected '%s' %zu time(s), got %zu%s\n",
+                   COLOR_RED, must_contain, expected_occurrences, occurrences, COLOR_RESET);
+            test_passed = false;
+        }
+    }
+
+    free(source);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+
+    printf("\n");
+}
+
+// Helper function to compile the generated C and compare it with evaluate()
+void test_codegen_compiled(const char* test_name, expr_t expr) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    char source_path[] = "/tmp/libseq_codegen_XXXXXX.c";
+    int fd = mkstemps(source_path, 2);
+    char library_path[sizeof(source_path) + 1];
+    snprintf(library_path, sizeof(library_path), "%.*sso", (int)strlen(source_path) - 1, source_path);
+
+    FILE *out = fdopen(fd, "w");
+    bool test_passed = codegen_c(out, &expr, "generated_fn", "xy", &gpa_allocator);
+    fclose(out);
+
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    char command[256];
+    snprintf(command, sizeof(command), "%s -O2 -shared -fPIC -o %s %s -lm", cc, library_path, source_path);
+    test_passed = test_passed && (system(command) == 0);
+
+    void *library = test_passed ? dlopen(library_path, RTLD_NOW) : NULL;
+    double (*scalar)(double, double) = library ? (double (*)(double, double))dlsym(library, "generated_fn") : NULL;
+    void (*batch)(size_t, const double*, const double*, double*) =
+        library ? (void (*)(size_t, const double*, const double*, double*))dlsym(library, "generated_fn_batch") : NULL;
+    test_passed = test_passed && scalar && batch;
+
+    f64 xs[] = { 0.5, 1.25, 2.0, 3.7, 0.5, 1.25, 2.0, 3.7, 0.5, 1.25, 2.0, 3.7 };
+    f64 ys[] = { -1.5, -1.5, -1.5, -1.5, 0.25, 0.25, 0.25, 0.25, 2.0, 2.0, 2.0, 2.0 };
+    f64 batched[12];
+    usize n = sizeof(xs) / sizeof(xs[0]);
+    usize mismatches = 0;
+
+    if (test_passed) {
+        batch(n, xs, ys, batched);
+
+        for (usize i = 0; i < n; i++) {
+            f64 point[] = { xs[i], ys[i] };
+            f64 reference = evaluate(&expr, "xy", point);
+            f64 got[] = { scalar(xs[i], ys[i]), batched[i] };
+
+            for (usize k = 0; k < 2; k++) {
+                bool same = (got[k] == reference) || (isnan(got[k]) && isnan(reference))
+                    || (fabs(got[k] - reference) <= 1e-12 * fabs(reference));
+                if (!same) mismatches++;
+            }
+        }
+    }
+
+    test_passed = test_passed && (mismatches == 0);
+    printf("%s%s generated code %s, %zu mismatches against evaluate()%s\n\n", test_passed ? COLOR_GREEN : COLOR_RED,
+           test_passed ? "✓" : "✗", (scalar && batch) ? "compiled and loaded" : "failed to build", mismatches, COLOR_RESET);
+
+    if (library) dlclose(library);
+    unlink(source_path);
+    unlink(library_path);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Checks that the folding constructors fold at compile time when optimizing:
+// a constant tree behind __builtin_constant_p guards an undefined function
+// with gcc's error attribute, so the probe only compiles once the guard is
+// folded away. the unoptimized build has to fail, which shows the check bites
+bool constructor_folding_compiles(const char *optimization) {
+    char source_path[] = "/tmp/libseq_fold_XXXXXX.c";
+    int fd = mkstemps(source_path, 2);
+
+    // the headers sit next to this file's directory (relative to where
+    // the suite runs from, like the Makefile's paths)
+    const char *file = __FILE__;
+    const char *slash = strrchr(file, '/');
+    int dir_len = slash ? (int)(slash - file) : 1;
+    const char *dir = slash ? file : ".";
+
+    FILE *out = fdopen(fd, "w");
+    fprintf(out,
+            "#include \"expressions.h\"\n"
+            "extern void not_folded(void) __attribute__((error(\"constructor folding left for runtime\")));\n"
+            "double folded(void) {\n"
+            "  expr_t e = Product(&Sum(&Const(2), &Const(3)), &Power(&Const(2), &Negation(&Const(-3))));\n"
+            "  if (!__builtin_constant_p(e.variant) || !__builtin_constant_p(e.constant) || (e.variant != EXPR_CONSTANT)) not_folded();\n"
+            "  return e.constant;\n"
+            "}\n");
+    fclose(out);
+
+    const char *cc = getenv("CC") ? getenv("CC") : "cc";
+    char command[512];
+    snprintf(command, sizeof(command), "%s -std=gnu2x %s -I%.*s/../src -c -o /dev/null %s 2>/dev/null",
+             cc, optimization, dir_len, dir, source_path);
+    bool compiled = system(command) == 0;
+
+    unlink(source_path);
+    return compiled;
+}
+
+// a tree at file scope, which only the raw constructors can build
+static expr_t file_scope_tree = BinaryNode(EXPR_SUM, &Const(2), &BinaryNode(EXPR_PRODUCT, &Var('x'), &UnaryNode(EXPR_NEGATION, &Const(3))));
+
+// Helpers for fastmath accuracy: errors in ulps of the (wider) reference
+static double ulps_f64(f64 got, long double reference) {
+    if (isnan(got) && isnan(reference)) return 0.0;
+    if (got == reference) return 0.0;
+
+    int exponent;
+    frexpl(reference, &exponent);
+    long double ulp = ldexpl(1.0L, (exponent - 53 < -1074) ? -1074 : exponent - 53);
+    return (double)(fabsl((long double)got - reference) / ulp);
+}
+
+static double ulps_f32(f32 got, f64 reference) {
+    if (isnan(got) && isnan(reference)) return 0.0;
+    if (got == reference) return 0.0;
+
+    int exponent;
+    frexp(reference, &exponent);
+    double ulp = ldexp(1.0, (exponent - 24 < -149) ? -149 : exponent - 24);
+    return fabs((double)got - reference) / ulp;
+}
+
+static long double reference_f64(fastmath_op_t op, long double x, long double y) {
+    switch (op) {
+        case FASTMATH_OP_SIN: return sinl(x);
+        case FASTMATH_OP_COS: return cosl(x);
+        case FASTMATH_OP_TAN: return tanl(x);
+        case FASTMATH_OP_EXP: return expl(x);
+        case FASTMATH_OP_LOG: return logl(x);
+        case FASTMATH_OP_POW: return powl(x, y);
+    }
+    return NAN;
+}
+
+#define FASTMATH_SAMPLES 100000
+
+// Samples [lo, hi] (log-uniformly when lo > 0) and checks the worst error
+// against max_ulps for both precisions
+void test_fastmath_accuracy(const char* test_name, fastmath_op_t op, fastmath_accuracy_t accuracy,
+                            f64 lo, f64 hi, double max_ulps_f64, double max_ulps_f32) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    f64 *x GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * FASTMATH_SAMPLES);
+    f64 *y GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * FASTMATH_SAMPLES);
+    f64 *out GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * FASTMATH_SAMPLES);
+    f32 *x32 GPA_DEALLOC = (f32*)gpa_allocator.alloc(sizeof(f32) * FASTMATH_SAMPLES);
+    f32 *y32 GPA_DEALLOC = (f32*)gpa_allocator.alloc(sizeof(f32) * FASTMATH_SAMPLES);
+    f32 *out32 GPA_DEALLOC = (f32*)gpa_allocator.alloc(sizeof(f32) * FASTMATH_SAMPLES);
+
+    srand(42);
+    for (usize i = 0; i < FASTMATH_SAMPLES; i++) {
+        double u = rand() / (double)RAND_MAX;
+        x[i] = (lo > 0.0) ? exp(log(lo) + u * (log(hi) - log(lo))) : lo + u * (hi - lo);
+        y[i] = -8.0 + 16.0 * (rand() / (double)RAND_MAX);
+        x32[i] = (f32)x[i];
+        y32[i] = (f32)y[i];
+    }
+
+    fastmath_map_f64(op, out, x, (op == FASTMATH_OP_POW) ? y : NULL, FASTMATH_SAMPLES, accuracy);
+    fastmath_map_f32(op, out32, x32, (op == FASTMATH_OP_POW) ? y32 : NULL, FASTMATH_SAMPLES, accuracy);
+
+    double worst_f64 = 0.0, worst_f32 = 0.0;
+    for (usize i = 0; i < FASTMATH_SAMPLES; i++) {
+        worst_f64 = fmax(worst_f64, ulps_f64(out[i], reference_f64(op, x[i], y[i])));
+
+        f64 reference = (f64)reference_f64(op, x32[i], y32[i]);
+        if (fabs(reference) <= FLT_MAX) worst_f32 = fmax(worst_f32, ulps_f32(out32[i], reference));
+    }
+
+    bool test_passed = (worst_f64 <= max_ulps_f64) && (worst_f32 <= max_ulps_f32);
+
+    printf("%s%s worst f64 error: %.3f ulp (bound %.3g), worst f32 error: %.3f ulp (bound %.3g)%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗",
+           worst_f64, max_ulps_f64, worst_f32, max_ulps_f32, COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Nearest doubles to k*pi/2 for every k below 2^19, where the reduced
+// argument cancels down to ~2^-60 of x and random samples never land
+void test_fastmath_pio2_multiples(const char* test_name, fastmath_op_t op) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    const usize n = (usize)1 << 19;
+    f64 *x GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+    f64 *out GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+
+    long double pio2 = acosl(-1.0L) / 2.0L;
+    for (usize k = 0; k < n; k++) x[k] = (f64)((long double)k * pio2);
+
+    fastmath_map_f64(op, out, x, NULL, n, FASTMATH_ULP1);
+
+    double worst = 0.0;
+    usize worst_k = 0, over = 0;
+    for (usize k = 0; k < n; k++) {
+        double error = ulps_f64(out[k], reference_f64(op, x[k], 0.0L));
+        if (error > 1.0) over++;
+        if (error > worst) {
+            worst = error;
+            worst_k = k;
+        }
+    }
+
+    bool test_passed = over == 0;
+
+    printf("%s%s worst error: %.3f ulp at x = %.17g, %zu of %zu over 1 ulp%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗",
+           worst, x[worst_k], over, n, COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Checks that every fastmath kernel agrees with libm on special values
+void test_fastmath_special_values() {
+    printf("=== Testing: fastmath special values ===\n");
+    total_tests++;
+
+    f64 x[] = { NAN, INFINITY, -INFINITY, 0.0, -0.0, 5e-324, 1e-310, -1.0, 709.7, 710.0, -745.0, -746.0, 1e6, 1e20 };
+    f64 y[] = { 0.0, -1.0, 3.0, 0.5, NAN, 0.0, 2.0, -1.0, 0.5, 2.0, 3.0, 1.0, -2.0, 0.5 };
+    usize n = sizeof(x) / sizeof(x[0]);
+    f64 out[sizeof(x) / sizeof(x[0])];
+
+    bool test_passed = true;
+
+    for (fastmath_op_t op = FASTMATH_OP_SIN; op <= FASTMATH_OP_POW; op++) {
+        for (fastmath_accuracy_t accuracy = FASTMATH_ULP1; accuracy <= FASTMATH_FAST; accuracy++) {
+            fastmath_map_f64(op, out, x, y, n, accuracy);
+
+            for (usize i = 0; i < n; i++) {
+                f64 reference = fastmath_libm_f64(op, x[i], y[i]);
+                bool same = (isnan(reference) && isnan(out[i])) ||
+                    ((reference == out[i]) && (signbit(reference) == signbit(out[i]))) ||
+                    (isfinite(reference) && (reference != 0.0) && (fabs(reference - out[i]) <= 1e-8 * fabs(reference)));
+
+                if (!same) {
+                    printf("%s✗ op %d accuracy %d at (%g, %g): got %g, libm %g%s\n",
+                           COLOR_RED, op, accuracy, x[i], y[i], out[i], reference, COLOR_RESET);
+                    test_passed = false;
+                }
+            }
+        }
+    }
+
+    if (test_passed) {
+        printf("%s✓ nan/inf/zero/subnormal/overflow behaviour matches libm%s\n", COLOR_GREEN, COLOR_RESET);
+        passed_tests++;
+    }
+
+    printf("\n");
+}
+
+// Checks the batched evaluator against the scalar one
+void test_evaluate_batch(const char* test_name, expr_t expr, fastmath_accuracy_t accuracy, double max_relative) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    usize n = 1000;
+    f64 *x GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+    f64 *y GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+    f64 *out GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+
+    for (usize i = 0; i < n; i++) {
+        x[i] = 0.1 + 0.01 * (f64)i;
+        y[i] = 2.0 - 0.003 * (f64)i;
+    }
+
+    const f64 *values[] = { x, y };
+    evaluate_batch(out, &expr, "xy", values, n, accuracy, &gpa_allocator);
+
+    double worst = 0.0;
+    for (usize i = 0; i < n; i++) {
+        f64 point[] = { x[i], y[i] };
+        f64 reference = evaluate(&expr, "xy", point);
+        worst = fmax(worst, fabs(out[i] - reference) / fmax(fabs(reference), 1e-300));
+    }
+
+    bool test_passed = worst <= max_relative;
+    printf("%s%s worst relative difference from evaluate(): %.3e (bound %.1e)%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", worst, max_relative, COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Helper function to test reduced precision evaluation against the f64 result
+void test_precision(const char* test_name, expr_t expr, evaluate_precision_t precision, double max_relative) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    usize n = 2000;
+    f64 *x GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+    f64 *y GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+
+    for (usize i = 0; i < n; i++) {
+        x[i] = 1e-3 + 0.9 * (f64)i / (f64)n;
+        y[i] = 0.5 + 0.25 * sin((f64)i);
+    }
+
+    const f64 *values[] = { x, y };
+    precision_error_t err = evaluate_precision_error(&expr, "xy", values, n, precision, FASTMATH_ULP1, &gpa_allocator);
+
+    bool test_passed = (err.compared == n) && (err.max_rel_error <= max_relative);
+    printf("%s%s max relative error %.3e (rms %.3e, bound %.1e) over %zu points%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗",
+           err.max_rel_error, err.rms_rel_error, max_relative, err.compared, COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Helper function to test that simplify_persistent() matches simplify() without touching its input
+void test_persistent_simplify(const char* test_name, expr_t expr, const char* expected_serialization) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    usize size = serialized_expr_size(&expr);
+    char *before GPA_DEALLOC = (char*)gpa_allocator.alloc(sizeof(char) * (size + 1));
+    char *after GPA_DEALLOC = (char*)gpa_allocator.alloc(sizeof(char) * (size + 1));
+    char *result GPA_DEALLOC = (char*)gpa_allocator.alloc(sizeof(char) * (size + 1));
+    memset(before, 0, size + 1);
+    memset(after, 0, size + 1);
+    memset(result, 0, size + 1);
+
+    serialize_expr(before, &expr);
+
+    expr_t *simplified = simplify_persistent(&expr, &gpa_allocator);
+
+    serialize_expr(after, &expr);
+    serialize_expr(result, simplified);
+    printf("Original: %s\nSimplified: %s\n", before, result);
+
+    bool test_passed = true;
+
+    if (strcmp(before, after) != 0) {
+        printf("%s✗ Input was modified: %s%s\n", COLOR_RED, after, COLOR_RESET);
+        test_passed = false;
+    }
+
+    if (strcmp(result, expected_serialization) != 0) {
+        printf("%s✗ Expected: %s, Got: %s%s\n", COLOR_RED, expected_serialization, result, COLOR_RESET);
+        test_passed = false;
+    }
+
+    free_simplified(&gpa_allocator, simplified, &expr);
+
+    // the in place version has to agree
+    simplify(&expr);
+    memset(after, 0, size + 1);
+    serialize_expr(after, &expr);
+
+    if (strcmp(after, result) != 0) {
+        printf("%s✗ simplify() gives: %s%s\n", COLOR_RED, after, COLOR_RESET);
+        test_passed = false;
+    }
+
+    if (test_passed) {
+        printf("%s✓ Input untouched, matches simplify(): %s%s\n", COLOR_GREEN, result, COLOR_RESET);
+        passed_tests++;
+    }
+
+    printf("\n");
+}
+
+typedef struct {
+    expr_t *root;
+    const char *expected;
+    bool ok;
+} persistent_worker_t;
+
+static void *persistent_simplify_worker(void *arg) {
+    persistent_worker_t *w = (persistent_worker_t*)arg;
+    char buffer[128];
+    w->ok = true;
+
+    for (int i = 0; i < 2000; i++) {
+        expr_t *simplified = simplify_persistent(w->root, &gpa_allocator);
+
+        memset(buffer, 0, sizeof(buffer));
+        serialize_expr(buffer, simplified);
+        if (strcmp(buffer, w->expected) != 0) w->ok = false;
+
+        free_simplified(&gpa_allocator, simplified, w->root);
+    }
+
+    return NULL;
+}
+
+// Helper function to test several threads simplifying one tree with a subtree shared by two parents
+void test_persistent_simplify_threads() {
+    printf("=== Testing: concurrent simplify_persistent on a shared tree ===\n");
+    total_tests++;
+
+    expr_t shared = BinaryNode(EXPR_SUM, &Const(2), &Const(3));
+    expr_t root = Product(&Sum(&shared, &Var('x')), &Negation(&Negation(&Product(&shared, &Var('y')))));
+
+    persistent_worker_t workers[4];
+    pthread_t threads[4];
+
+    // all four threads allocate through gpa_allocator, whose counter is atomic
+    usize before = __atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < 4; i++) {
+        workers[i] = (persistent_worker_t){ .root = &root, .expected = "(5+x)5y" };
+        pthread_create(&threads[i], NULL, persistent_simplify_worker, &workers[i]);
+    }
+
+    bool test_passed = true;
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+        test_passed = test_passed && workers[i].ok;
+    }
+
+    bool leaked = __atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED) != before;
+    test_passed = test_passed && (shared.variant == EXPR_SUM) && (root.args.y->variant == EXPR_NEGATION) && !leaked;
+
+    printf("%s%s 4 threads x 2000 simplifications, shared subtree %s%s%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗",
+           (shared.variant == EXPR_SUM) ? "untouched" : "modified", leaked ? " (leaked)" : "", COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Helper function to test that two differently grouped/ordered trees canonicalize to the same tree
+void test_canonical(const char* test_name, expr_t a, expr_t b, const char* expected_serialization) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    expr_t *ca = canonicalize_expr(&a, &gpa_allocator);
+    expr_t *cb = canonicalize_expr(&b, &gpa_allocator);
+
+    usize size = serialized_expr_size(ca);
+    char *buffer GPA_DEALLOC = (char*)gpa_allocator.alloc(sizeof(char) * (size + 1));
+    memset(buffer, 0, size + 1);
+    serialize_expr(buffer, ca);
+
+    expr_fingerprint_t fa = expr_fingerprint(ca);
+    expr_fingerprint_t fb = expr_fingerprint(cb);
+
+    bool test_passed = (expr_compare(ca, cb) == 0) && (fa.hi == fb.hi) && (fa.lo == fb.lo)
+        && (strcmp(buffer, expected_serialization) == 0);
+
+    if (test_passed) {
+        printf("%s✓ Both canonicalize to %s%s\n", COLOR_GREEN, buffer, COLOR_RESET);
+        passed_tests++;
+    } else {
+        printf("%s✗ Expected: %s, Got: %s (compare %d)%s\n", COLOR_RED, expected_serialization, buffer, expr_compare(ca, cb), COLOR_RESET);
+    }
+
+    free_expr(&gpa_allocator, ca);
+    free_expr(&gpa_allocator, cb);
+    printf("\n");
+}
+
+// Helper function to test the on-disk store: dedup, reopening and growth
+void test_expr_store(usize n) {
+    printf("=== Testing: expression store with %zu expressions ===\n", n);
+    total_tests++;
+
+    char path[] = "/tmp/libseq_store_XXXXXX";
+    i32 fd = mkstemp(path);
+    close(fd);
+
+    // leftover from a grow that crashed before its rename
+    char grow_path[sizeof(path) + 5];
+    snprintf(grow_path, sizeof(grow_path), "%s.grow", path);
+    FILE *stale = fopen(grow_path, "w");
+    fputs("half a table", stale);
+    fclose(stale);
+
+    expr_store_t store;
+    bool test_passed = expr_store_open(&store, path, &gpa_allocator);
+    usize false_hits = 0, misses = 0;
+
+    // c*x + y, inserted as written and again as y + x*c
+    for (usize i = 0; test_passed && (i < n); i++) {
+        expr_t e = Sum(&Product(&Const((f64)i), &Var('x')), &Var('y'));
+        expr_t *c = canonicalize_expr(&e, &gpa_allocator);
+        if (expr_store_insert(&store, c)) false_hits++;
+        free_expr(&gpa_allocator, c);
+    }
+
+    for (usize i = 0; test_passed && (i < n); i++) {
+        expr_t e = Sum(&Var('y'), &Product(&Var('x'), &Const((f64)i)));
+        expr_t *c = canonicalize_expr(&e, &gpa_allocator);
+        if (!expr_store_insert(&store, c)) misses++;
+        free_expr(&gpa_allocator, c);
+    }
+
+    if (test_passed) {
+        // growing renamed its table over the store, nothing is left behind
+        test_passed = (false_hits == 0) && (misses == 0) && (expr_store_count(&store) == n) && (access(grow_path, F_OK) != 0);
+        expr_store_close(&store);
+    }
+
+    // still there after reopening
+    if (test_passed && expr_store_open(&store, path, &gpa_allocator)) {
+        expr_t seen = Sum(&Var('y'), &Product(&Const(7), &Var('x')));
+        expr_t unseen = Sum(&Var('z'), &Product(&Const(7), &Var('x')));
+        expr_t *cs = canonicalize_expr(&seen, &gpa_allocator);
+        expr_t *cu = canonicalize_expr(&unseen, &gpa_allocator);
+
+        test_passed = (expr_store_count(&store) == n) && expr_store_contains(&store, cs) && !expr_store_contains(&store, cu);
+
+        free_expr(&gpa_allocator, cs);
+        free_expr(&gpa_allocator, cu);
+        expr_store_close(&store);
+    } else {
+        test_passed = false;
+    }
+
+    // anything that isn't a store is refused
+    FILE *junk = fopen(path, "w");
+    fputs("not a store", junk);
+    fclose(junk);
+    test_passed = test_passed && !expr_store_open(&store, path, &gpa_allocator);
+
+    unlink(path);
+    unlink(grow_path);
+
+    printf("%s%s %zu inserted, %zu false hits, %zu commuted duplicates missed%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", n, false_hits, misses, COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Helper function to check a derivative against a central difference
+void test_derivative(const char* test_name, expr_t expr, f64 from, f64 to) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    usize before = __active_gpa_allocations;
+    expr_t *d = differentiate(&expr, 'x', &gpa_allocator);
+
+    double worst = 0.0;
+    for (usize i = 0; i <= 20; i++) {
+        f64 x = from + (to - from) * (f64)i / 20.0;
+        f64 h = 1e-5 * fmax(1.0, fabs(x));
+        f64 above[] = { x + h }, below[] = { x - h }, point[] = { x };
+
+        f64 reference = (evaluate(&expr, "x", above) - evaluate(&expr, "x", below)) / (2.0 * h);
+        worst = fmax(worst, fabs(evaluate(d, "x", point) - reference) / fmax(fabs(reference), 1.0));
+    }
+
+    free_expr(&gpa_allocator, d);
+    bool leaked = __active_gpa_allocations != before;
+
+    bool test_passed = (worst <= 1e-6) && !leaked;
+    printf("%s%s worst relative difference from a central difference: %.3e%s%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", worst, leaked ? " (leaked nodes)" : "", COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Helper function to test find_roots() from a spread of starting points.
+// reports the total iteration count through `total_iterations`
+void test_roots(const char* test_name, expr_t expr, root_method_t method, f64 from, f64 to, f64 expected_root, u64 *total_iterations) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    usize n = 10000;
+    f64 *starts GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+    f64 *roots GPA_DEALLOC = (f64*)gpa_allocator.alloc(sizeof(f64) * n);
+    u32 *iterations GPA_DEALLOC = (u32*)gpa_allocator.alloc(sizeof(u32) * n);
+    root_status_t *status GPA_DEALLOC = (root_status_t*)gpa_allocator.alloc(sizeof(root_status_t) * n);
+
+    for (usize i = 0; i < n; i++) starts[i] = from + (to - from) * (f64)i / (f64)(n - 1);
+
+    root_options_t options = { .method = method, .tolerance = 1e-12, .max_iterations = 100, .accuracy = FASTMATH_STRICT };
+    find_roots(roots, iterations, status, &expr, 'x', starts, n, options, &gpa_allocator);
+
+    usize converged = 0;
+    double worst = 0.0;
+    *total_iterations = 0;
+
+    for (usize i = 0; i < n; i++) {
+        *total_iterations += iterations[i];
+        if (status[i] != ROOT_CONVERGED) continue;
+        converged++;
+        worst = fmax(worst, fabs(roots[i] - expected_root));
+    }
+
+    bool test_passed = (converged == n) && (worst <= 1e-10);
+    printf("%s%s %zu/%zu converged, worst error %.3e, %.2f iterations per point%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", converged, n, worst,
+           (f64)*total_iterations / (f64)n, COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
+// Helper function to test integrate_with() against a known integral
+void test_integrate(const char* test_name, expr_t expr, const char* variables, const f64 *lower, const f64 *upper,
+                    f64 tolerance, u32 threads, double expected) {
+    printf("=== Testing: %s ===\n", test_name);
+    total_tests++;
+
+    integrate_options_t options = INTEGRATE_DEFAULTS;
+    options.threads = threads;
+
+    // the workers allocate concurrently, gpa_allocator's counter is atomic
+    usize before = __atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED);
+    integral_t result = integrate_with(&expr, variables, lower, upper, tolerance, options, &gpa_allocator);
+    bool leaked = __atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED) != before;
+
+    double actual_error = fabs(result.value - expected);
+    bool test_passed = result.converged && (actual_error <= tolerance) && (result.error <= tolerance) && !leaked;
+    printf("%s%s %.15g (expected %.15g), error %.3e, estimated %.3e, %zu regions%s%s\n\n",
+           test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", result.value, expected, actual_error,
+           result.error, result.regions, leaked ? " (leaked)" : "", COLOR_RESET);
+
+    if (test_passed) {
+        passed_tests++;
+    }
+}
+
 int main() {
     printf("%s=== COMPREHENSIVE EXPRESSION LIBRARY TEST SUITE ===%s\n\n", 
            COLOR_BOLD COLOR_BLUE, COLOR_RESET);
@@ -87,55 +818,58 @@ int main() {
     test_expression("Variable x", var_x, "x", INFINITY);
     
     // Test basic arithmetic
-    test_expression("Addition: 3 + 2", Sum(&Const(3), &Const(2)), "5", 5.0);
+    test_expression("Addition: 3 + 2", BinaryNode(EXPR_SUM, &Const(3), &Const(2)), "5", 5.0);
                    
-    test_expression("Subtraction: 7 - 3", Difference(&Const(7), &Const(3)), "4", 4.0);
+    test_expression("Subtraction: 7 - 3", BinaryNode(EXPR_DIFFERENCE, &Const(7), &Const(3)), "4", 4.0);
                    
-    test_expression("Multiplication: 4 * 6", Product(&Const(4), &Const(6)), "24", 24.0);
+    test_expression("Multiplication: 4 * 6", BinaryNode(EXPR_PRODUCT, &Const(4), &Const(6)), "24", 24.0);
                    
-    test_expression("Division: 15 / 3", Quotient(&Const(15), &Const(3)), "5", 5.0);
+    test_expression("Division: 15 / 3", BinaryNode(EXPR_QUOTIENT, &Const(15), &Const(3)), "5", 5.0);
     
     // Test powers and exponentials
-    test_expression("Power: 2^3", Power(&Const(2), &Const(3)), "8", 8.0);
+    test_expression("Power: 2^3", BinaryNode(EXPR_POWER, &Const(2), &Const(3)), "8", 8.0);
                    
-    test_expression("Power: 9^0.5", Power(&Const(9), &Const(0.5)), "3", 3.0);
+    test_expression("Power: 9^0.5", BinaryNode(EXPR_POWER, &Const(9), &Const(0.5)), "3", 3.0);
                    
-    test_expression("Exponential: e^2", Exponential(&Const(M_E), &Const(2)), NULL, exp(2.0));
+    test_expression("Exponential: e^2", BinaryNode(EXPR_EXPONENTIAL, &Const(M_E), &Const(2)), NULL, exp(2.0));
     
     // Test logarithms
-    test_expression("Natural log: ln(e^2)", Logarithm(&Const(M_E), &Power(&Const(M_E), &Const(2))), "2", 2.0);
+    test_expression("Natural log: ln(e^2)", BinaryNode(EXPR_LOGARITHM, &Const(M_E), &BinaryNode(EXPR_POWER, &Const(M_E), &Const(2))), "2", 2.0);
                    
-    test_expression("Log base 10: log₁₀(100)", Logarithm(&Const(10), &Const(100)), "2", 2.0);
+    test_expression("Log base 10: log₁₀(100)", BinaryNode(EXPR_LOGARITHM, &Const(10), &Const(100)), "2", 2.0);
                    
-    test_expression("Log base 2: log₂(8)", Logarithm(&Const(2), &Const(8)), "3", 3.0);
+    test_expression("Log base 2: log₂(8)", BinaryNode(EXPR_LOGARITHM, &Const(2), &Const(8)), "3", 3.0);
     
     // Test trigonometric functions
-    test_expression("sin(0)", Sin(&Const(0)), "0", 0.0);
+    test_expression("sin(0)", UnaryNode(EXPR_SIN, &Const(0)), "0", 0.0);
                    
-    test_expression("cos(0)", Cos(&Const(0)), "1", 1.0);
+    test_expression("cos(0)", UnaryNode(EXPR_COS, &Const(0)), "1", 1.0);
                    
-    test_expression("sin(π/2)", Sin(&Const(M_PI/2)), "1", 1.0);
+    test_expression("sin(π/2)", UnaryNode(EXPR_SIN, &Const(M_PI/2)), "1", 1.0);
                    
-    test_expression("cos(π)", Cos(&Const(M_PI)), "-1", -1.0);
+    test_expression("cos(π)", UnaryNode(EXPR_COS, &Const(M_PI)), "-1", -1.0);
                    
-    test_expression("tan(π/4)", Tan(&Const(M_PI/4)), "1", 1.0);
+    test_expression("tan(π/4)", UnaryNode(EXPR_TAN, &Const(M_PI/4)), "1", 1.0);
     
     // Test negation
-    test_expression("Negation: -5", Negation(&Const(5)), "-5", -5.0);
+    test_expression("Negation: -5", UnaryNode(EXPR_NEGATION, &Const(5)), "-5", -5.0);
                    
-    test_expression("Double negation: -(-3)", Negation(&Negation(&Const(3))), "3", 3.0);
+    test_expression("Double negation: -(-3)", UnaryNode(EXPR_NEGATION, &UnaryNode(EXPR_NEGATION, &Const(3))), "3", 3.0);
     
     // Test inverse
-    test_expression("Inverse: 1/4", Inverse(&Const(4)), "0.25", 0.25);
+    test_expression("Inverse: 1/4", UnaryNode(EXPR_INVERSE, &Const(4)), "0.25", 0.25);
                    
-    test_expression("Inverse of inverse: (1/(1/2))", Inverse(&Inverse(&Const(2))), "2", 2.0);
+    test_expression("Inverse of inverse: (1/(1/2))", UnaryNode(EXPR_INVERSE, &UnaryNode(EXPR_INVERSE, &Const(2))), "2", 2.0);
     
     // Test complex expressions
-    test_expression("Complex: (2 + 3) * 4", Product(&Sum(&Const(2), &Const(3)), &Const(4)), "20", 20.0);
+    test_expression("Complex: (2 + 3) * 4", BinaryNode(EXPR_PRODUCT, &BinaryNode(EXPR_SUM, &Const(2), &Const(3)), &Const(4)), "20", 20.0);
                    
-    test_expression("Complex: 2^3 + 3^2", Sum(&Power(&Const(2), &Const(3)), &Power(&Const(3), &Const(2))), "17", 17.0);
+    test_expression("Complex: 2^3 + 3^2",
+                    BinaryNode(EXPR_SUM, &BinaryNode(EXPR_POWER, &Const(2), &Const(3)), &BinaryNode(EXPR_POWER, &Const(3), &Const(2))), "17", 17.0);
                    
-    test_expression("Complex: sin²(π/6) + cos²(π/6)", Sum(&Power(&Sin(&Const(M_PI/6)), &Const(2)), &Power(&Cos(&Const(M_PI/6)), &Const(2))), "1", 1.0);
+    test_expression("Complex: sin²(π/6) + cos²(π/6)",
+                    BinaryNode(EXPR_SUM, &BinaryNode(EXPR_POWER, &UnaryNode(EXPR_SIN, &Const(M_PI/6)), &Const(2)),
+                               &BinaryNode(EXPR_POWER, &UnaryNode(EXPR_COS, &Const(M_PI/6)), &Const(2))), "1", 1.0);
     
     // Test expressions with variables (should not simplify to constants)
     expr_t x = Var('x');
@@ -156,30 +890,479 @@ int main() {
     // Test edge cases
     printf("%s=== Testing edge cases ===%s\n", COLOR_YELLOW, COLOR_RESET);
     
-    test_expression("Division by 1: 7/1", Quotient(&Const(7), &Const(1)), "7", 7.0);
+    test_expression("Division by 1: 7/1", BinaryNode(EXPR_QUOTIENT, &Const(7), &Const(1)), "7", 7.0);
                    
-    test_expression("Multiplication by 0: 5*0", Product(&Const(5), &Const(0)), "0", 0.0);
+    test_expression("Multiplication by 0: 5*0", BinaryNode(EXPR_PRODUCT, &Const(5), &Const(0)), "0", 0.0);
                    
-    test_expression("Power to 0: 5^0", Power(&Const(5), &Const(0)), "1", 1.0);
+    test_expression("Power to 0: 5^0", BinaryNode(EXPR_POWER, &Const(5), &Const(0)), "1", 1.0);
                    
-    test_expression("Power to 1: 7^1", Power(&Const(7), &Const(1)), "7", 7.0);
+    test_expression("Power to 1: 7^1", BinaryNode(EXPR_POWER, &Const(7), &Const(1)), "7", 7.0);
 
     // Test nested expressions
     printf("%s=== Testing deeply nested expressions ===%s\n", COLOR_YELLOW, COLOR_RESET);
 
-    expr_t nested = Sum(&Product(&Sin(&Const(M_PI/2)), &Cos(&Const(0))), &Power(&Const(2), &Logarithm(&Const(2), &Const(8))));
+    expr_t nested = BinaryNode(EXPR_SUM, &BinaryNode(EXPR_PRODUCT, &UnaryNode(EXPR_SIN, &Const(M_PI/2)), &UnaryNode(EXPR_COS, &Const(0))),
+                               &BinaryNode(EXPR_POWER, &Const(2), &BinaryNode(EXPR_LOGARITHM, &Const(2), &Const(8))));
 
     test_expression("sin(π/2) * cos(0) + 2^(log₂(8))", nested, "9", 9.0);
 
     // Test your original complex expression
     printf("%s=== Testing original complex expression ===%s\n", COLOR_YELLOW, COLOR_RESET);
     
-    expr_t original = Quotient(
-        &Sum(&Var('p'), &Product(&Var('q'), &Sum(&Sin(&Const(6)), 
-             &Sum(&Sum(&Const(5), &Product(&Const(3), &Inverse(&Const(2)))), &Const(5))))),
-        &Inverse(&Inverse(&Inverse(&Const(8))))
+    expr_t original = BinaryNode(EXPR_QUOTIENT, 
+        &BinaryNode(EXPR_SUM, &Var('p'), &BinaryNode(EXPR_PRODUCT, &Var('q'), &BinaryNode(EXPR_SUM, &UnaryNode(EXPR_SIN, &Const(6)), 
+             &BinaryNode(EXPR_SUM, &BinaryNode(EXPR_SUM, &Const(5),
+                                   &BinaryNode(EXPR_PRODUCT, &Const(3), &UnaryNode(EXPR_INVERSE, &Const(2)))), &Const(5))))),
+        &UnaryNode(EXPR_INVERSE, &UnaryNode(EXPR_INVERSE, &UnaryNode(EXPR_INVERSE, &Const(8))))
     );
     test_expression("Original complex expression", original, NULL, INFINITY);
+
+    // Test polynomial canonical form
+    printf("%s=== Testing sparse polynomial expansion ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    f64 xy[] = { 3.0, -2.0 };
+
+    test_polynomial("(x+y)² - (x-y)²",
+        Difference(&Power(&Sum(&Var('x'), &Var('y')), &Const(2)), &Power(&Difference(&Var('x'), &Var('y')), &Const(2))),
+        "4*x*y", xy, -24.0);
+
+    test_polynomial("(x+1)(x-1)", Product(&Sum(&Var('x'), &Const(1)), &Difference(&Var('x'), &Const(1))),
+        "(x^2)-1", xy, 8.0);
+
+    test_polynomial("x - x", Difference(&Var('x'), &Var('x')), "0", xy, 0.0);
+    test_polynomial("(x + 1) - 1", Difference(&Sum(&Var('x'), &Const(1)), &Const(1)), "x", xy, xy[0]);
+    test_polynomial("(x + 2) - x", Difference(&Sum(&Var('x'), &Const(2)), &Var('x')), "2", xy, 2.0);
+
+    test_polynomial("(2x + 3y - 1)^10", Power(&Difference(&Sum(&Product(&Const(2), &Var('x')), &Product(&Const(3), &Var('y'))), &Const(1)), &Const(10)),
+        NULL, xy, 1.0);
+
+    test_polynomial("-(x*y)^3 + 5", Sum(&Negation(&Power(&Product(&Var('x'), &Var('y')), &Const(3))), &Const(5)),
+        NULL, xy, 221.0);
+
+    {
+        printf("=== Testing: expansion past the degree limit is refused ===\n");
+        total_tests++;
+
+        poly_t p;
+        expr_t too_high = Power(&Var('x'), &Const(300));
+        expr_t product_too_high = Product(&Power(&Sum(&Var('x'), &Var('y')), &Const(200)), &Power(&Var('x'), &Const(100)));
+        expr_t at_limit = Power(&Product(&Var('x'), &Var('y')), &Const(255));
+
+        bool test_passed = !poly_from_expr(&p, &too_high, &gpa_allocator) && !poly_from_expr(&p, &product_too_high, &gpa_allocator);
+
+        if (poly_from_expr(&p, &at_limit, &gpa_allocator)) {
+            test_passed = test_passed && (p.len == 1) && (monomial_exponent(p.terms[0].monomial, 0) == 255);
+            poly_free(&p);
+        } else {
+            test_passed = false;
+        }
+
+        printf("%s%s x^300 and (x+y)^200 x^100 refused, (xy)^255 expanded%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    {
+        printf("=== Testing: poly_mul/poly_pow fail on exponent overflow ===\n");
+        total_tests++;
+
+        usize allocations_before = __atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED);
+
+        poly_t p, q, out;
+        expr_t high = Sum(&Power(&Var('x'), &Const(200)), &Var('y'));
+        expr_t low = Sum(&Power(&Var('x'), &Const(55)), &Var('y'));
+
+        bool test_passed = poly_from_expr(&p, &high, &gpa_allocator) && poly_from_expr(&q, &low, &gpa_allocator);
+
+        if (test_passed) {
+            test_passed = !poly_mul(&out, &p, &p) && !poly_pow(&out, &p, 2) && !poly_pow(&out, &q, 5);
+
+            // x^255 is exactly at the limit
+            if (poly_mul(&out, &p, &q)) {
+                test_passed = test_passed && (monomial_exponent(out.terms[0].monomial, 0) == 255);
+                poly_free(&out);
+            } else {
+                test_passed = false;
+            }
+
+            poly_free(&p);
+            poly_free(&q);
+        }
+
+        test_passed = test_passed && (__atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED) == allocations_before);
+
+        printf("%s%s (x^200+y)², (x^55+y)^5 refused without leaking, (x^200+y)(x^55+y) multiplied%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    // Test C code generation
+    printf("%s=== Testing C code generation ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    test_codegen("CSE: sin(x)*sin(x) + sin(x)", Sum(&Product(&Sin(&Var('x')), &Sin(&Var('x'))), &Sin(&Var('x'))), NULL, "sin(", 1);
+
+    test_codegen("Integer power expansion: x^5 + y^-2", Sum(&Power(&Var('x'), &Const(5)), &Power(&Var('y'), &Const(-2))), "xy", "pow(", 0);
+
+    test_codegen("Non-integer power kept: x^0.5", Power(&Var('x'), &Const(0.5)), NULL, "pow(", 1);
+
+    test_codegen("Explicit parameter order", Difference(&Var('y'), &Var('x')), "xyz", "double generated_fn(double x, double y, double z)", 1);
+
+    test_codegen("Squares shared between powers: x^3 + x^-2", Sum(&Power(&Var('x'), &Const(3)), &Power(&Var('x'), &Const(-2))), NULL, "x * x", 1);
+
+    test_codegen("Powers share partial products: x^4 + x^6 + x^7",
+                 Sum(&Sum(&Power(&Var('x'), &Const(4)), &Power(&Var('x'), &Const(6))), &Power(&Var('x'), &Const(7))), NULL, " * ", 5);
+
+    {
+        printf("=== Testing: codegen refuses names that aren't C identifiers or are taken ===\n");
+        total_tests++;
+
+        expr_t e = Sum(&Var('x'), &Var('y'));
+        FILE *sink = fopen("/dev/null", "w");
+
+        bool test_passed = !codegen_c(sink, &e, "f(void); int g", NULL, &gpa_allocator)
+            && !codegen_c(sink, &e, "9lives", NULL, &gpa_allocator)
+            && !codegen_c(sink, &e, "f", "x y", &gpa_allocator)
+            && !codegen_c(sink, &e, "f", "xyx", &gpa_allocator)
+            && codegen_c(sink, &e, "_f2", "yx", &gpa_allocator);
+
+        // names the generated code already uses: a parameter, a libm function
+        // it calls, one it would shadow, a CSE temporary, a keyword, the
+        // batch function's own parameters
+        expr_t shared = Sum(&Sin(&Product(&Var('x'), &Var('y'))), &Cos(&Product(&Var('x'), &Var('y'))));
+        const char *taken[] = { "x", "y", "sin", "pow", "log", "exp", "t0", "t12", "double", "out", "count", "idx", "INFINITY" };
+
+        for (usize i = 0; i < sizeof(taken) / sizeof(taken[0]); i++) {
+            if (codegen_c(sink, &shared, taken[i], "xy", &gpa_allocator)) {
+                printf("%s✗ accepted the name %s%s\n", COLOR_RED, taken[i], COLOR_RESET);
+                test_passed = false;
+            }
+        }
+
+        test_passed = test_passed && codegen_c(sink, &shared, "t", "xy", &gpa_allocator)
+            && codegen_c(sink, &shared, "z", "xy", &gpa_allocator) && codegen_c(sink, &shared, "t1x", "xy", &gpa_allocator);
+        fclose(sink);
+
+        printf("%s%s bad function and parameter names rejected%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    test_codegen("Non-finite constants: x + 1/0", Sum(&Var('x'), &Quotient(&Const(1), &Const(0))), NULL, "x + INFINITY", 1);
+
+    test_codegen("Non-finite constants: x * -(1/0)", Product(&Var('x'), &Negation(&Inverse(&Const(0)))), NULL, "x * (-INFINITY);", 1);
+
+    test_codegen("Non-finite constants: x + 0/0", Sum(&Var('x'), &Quotient(&Const(0), &Const(0))), NULL, "x + NAN;", 1);
+
+    test_codegen_compiled("Compiled: x^3 + x^-2 + sin(x) y",
+                          Sum(&Sum(&Power(&Var('x'), &Const(3)), &Power(&Var('x'), &Const(-2))), &Product(&Sin(&Var('x')), &Var('y'))));
+    test_codegen_compiled("Compiled: log_2(x) / (y + 2) - x^0.5", Difference(&Quotient(&Logarithm(&Const(2), &Var('x')), &Sum(&Var('y'), &Const(2))), &Power(&Var('x'), &Const(0.5))));
+    test_codegen_compiled("Compiled: x^4 + x^6 + x^7 - y^-3 + y^1",
+                          Sum(&Difference(&Sum(&Sum(&Power(&Var('x'), &Const(4)), &Power(&Var('x'), &Const(6))), &Power(&Var('x'), &Const(7))),
+                                          &Power(&Var('y'), &Const(-3))), &Power(&Var('y'), &Const(1))));
+    test_codegen_compiled("Compiled: x + 1/0", Sum(&Var('x'), &Quotient(&Const(1), &Const(0))));
+    test_codegen_compiled("Compiled: y * (0/0) - x", Difference(&Product(&Var('y'), &Quotient(&Const(0), &Const(0))), &Var('x')));
+
+    // Test vectorized transcendental kernels
+    printf("%s=== Testing fastmath kernels ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    test_fastmath_accuracy("sin, <= 1 ulp", FASTMATH_OP_SIN, FASTMATH_ULP1, -1000.0, 1000.0, 1.0, 1.0);
+    test_fastmath_accuracy("cos, <= 1 ulp", FASTMATH_OP_COS, FASTMATH_ULP1, -1000.0, 1000.0, 1.0, 1.0);
+    test_fastmath_accuracy("tan, <= 1 ulp", FASTMATH_OP_TAN, FASTMATH_ULP1, -1000.0, 1000.0, 1.0, 1.0);
+    test_fastmath_accuracy("sin, large |x| <= 1 ulp", FASTMATH_OP_SIN, FASTMATH_ULP1, -1e6, 1e6, 1.0, 1.0);
+    test_fastmath_pio2_multiples("sin at multiples of pi/2, <= 1 ulp", FASTMATH_OP_SIN);
+    test_fastmath_pio2_multiples("cos at multiples of pi/2, <= 1 ulp", FASTMATH_OP_COS);
+    test_fastmath_pio2_multiples("tan at multiples of pi/2, <= 1 ulp", FASTMATH_OP_TAN);
+    test_fastmath_accuracy("exp, <= 1 ulp", FASTMATH_OP_EXP, FASTMATH_ULP1, -745.0, 709.0, 1.0, 1.0);
+    test_fastmath_accuracy("log, <= 1 ulp", FASTMATH_OP_LOG, FASTMATH_ULP1, 1e-300, 1e300, 1.0, 1.0);
+    test_fastmath_accuracy("log near 1, <= 1 ulp", FASTMATH_OP_LOG, FASTMATH_ULP1, 0.5, 2.0, 1.0, 1.0);
+    test_fastmath_accuracy("pow, <= 1 ulp", FASTMATH_OP_POW, FASTMATH_ULP1, 1e-3, 1e3, 1.0, 1.0);
+
+    // fast: 1e-8 relative is ~2^26.6 f64 ulps
+    test_fastmath_accuracy("sin, fast", FASTMATH_OP_SIN, FASTMATH_FAST, -1000.0, 1000.0, 0x1p27, 4.0);
+    test_fastmath_accuracy("cos, fast", FASTMATH_OP_COS, FASTMATH_FAST, -1000.0, 1000.0, 0x1p27, 4.0);
+    test_fastmath_accuracy("tan, fast", FASTMATH_OP_TAN, FASTMATH_FAST, -1000.0, 1000.0, 0x1p27, 4.0);
+    test_fastmath_accuracy("exp, fast", FASTMATH_OP_EXP, FASTMATH_FAST, -80.0, 80.0, 0x1p27, 4.0);
+    test_fastmath_accuracy("log, fast", FASTMATH_OP_LOG, FASTMATH_FAST, 1e-30, 1e30, 0x1p27, 4.0);
+    test_fastmath_accuracy("pow, fast", FASTMATH_OP_POW, FASTMATH_FAST, 1e-3, 1e3, 0x1p27, 4.0);
+
+    test_fastmath_special_values();
+
+    expr_t batch_expr = Sum(&Product(&Sin(&Var('x')), &Power(&Var('y'), &Const(3))),
+        &Quotient(&Logarithm(&Const(2), &Var('x')), &Sum(&Exponential(&Var('x'), &Var('y')), &Tan(&Var('y')))));
+
+    test_evaluate_batch("evaluate_batch strict", batch_expr, FASTMATH_STRICT, 0.0);
+    test_evaluate_batch("evaluate_batch <= 1 ulp kernels", batch_expr, FASTMATH_ULP1, 1e-13);
+    test_evaluate_batch("evaluate_batch fast kernels", batch_expr, FASTMATH_FAST, 1e-5);
+
+    // Test mixed precision evaluation
+    printf("%s=== Testing reduced precision evaluation ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    expr_t smooth = Sum(&Product(&Sin(&Var('x')), &Power(&Var('y'), &Const(3))), &Exponential(&Var('x'), &Var('y')));
+
+    test_precision("f64 mode is exact", smooth, EVALUATE_F64, 1e-15);
+    test_precision("f32 mode", smooth, EVALUATE_F32, 1e-6);
+    test_precision("f16 mode", smooth, EVALUATE_F16, 5e-3);
+
+    // (1 + x) - 1 cancels: rounding 1 + x to f32 first would cost ~x/eps
+    expr_t cancelling = Difference(&Sum(&Const(1), &Product(&Const(1e-3), &Var('x'))), &Const(1));
+    test_precision("f32 sum chain accumulated in f64", cancelling, EVALUATE_F32, 1e-6);
+
+    {
+        printf("=== Testing: f16 mode rounds f64 values once ===\n");
+        total_tests++;
+
+        // both sit just above an f16 tie that an f32 rounding first would
+        // land exactly on, and ties-to-even then takes them down
+        expr_t constant = Const(1.0 + 0x1p-11 + 0x1p-30);
+        expr_t chain = Sum(&Sum(&Var('x'), &Const(1)), &Const(0x1p-20));
+
+        f16 x16[] = { 2048.0f16 };
+        const f16 *values16[] = { x16 };
+        f16 c16, s16;
+        evaluate_batch_f16(&c16, &constant, "x", values16, 1, FASTMATH_ULP1, &gpa_allocator);
+        evaluate_batch_f16(&s16, &chain, "x", values16, 1, FASTMATH_ULP1, &gpa_allocator);
+
+        bool test_passed = ((f64)c16 == 1.0 + 0x1p-10) && ((f64)s16 == 2050.0);
+        printf("%s%s 1+2^-11+2^-30 gives %.10g (want %.10g), 2048+1+2^-20 gives %g (want 2050)%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗",
+               (f64)c16, 1.0 + 0x1p-10, (f64)s16, COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    // Test non-destructive simplification
+    printf("%s=== Testing persistent simplification ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    test_persistent_simplify("Persistent constant folding",
+                             BinaryNode(EXPR_PRODUCT, &BinaryNode(EXPR_SUM, &Const(1), &Const(2)), &BinaryNode(EXPR_POWER, &Const(2), &Const(3))), "24");
+    test_persistent_simplify("Persistent partial folding", Sum(&Sin(&Var('x')), &BinaryNode(EXPR_PRODUCT, &Const(2), &Const(3))), "sin(x)+6");
+    test_persistent_simplify("Persistent double negation", Negation(&Negation(&Cos(&Quotient(&Var('x'), &Const(4))))), "cos((x/4))");
+    test_persistent_simplify("Persistent fold under a double negation",
+                             BinaryNode(EXPR_SUM, &UnaryNode(EXPR_NEGATION, &UnaryNode(EXPR_NEGATION, &Const(2))), &Const(3)), "5");
+    test_persistent_simplify("Persistent nothing to do", Product(&Var('x'), &Tan(&Var('y'))), "x*tan(y)");
+
+    {
+        printf("=== Testing: unchanged subtrees are reused ===\n");
+        total_tests++;
+
+        expr_t untouched = Sin(&Var('x'));
+        expr_t folded = BinaryNode(EXPR_PRODUCT, &Const(2), &Const(3));
+        expr_t e = Sum(&untouched, &folded);
+
+        expr_t *simplified = simplify_persistent(&e, &gpa_allocator);
+        bool test_passed = (simplified != &e) && (simplified->args.x == &untouched)
+            && (simplified->args.y != &folded) && (folded.variant == EXPR_PRODUCT)
+            && (simplify_persistent(&untouched, &gpa_allocator) == &untouched);
+
+        printf("%s%s sin(x) shared by pointer, 2*3 folded into a new node%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", COLOR_RESET);
+        if (test_passed) passed_tests++;
+
+        free_simplified(&gpa_allocator, simplified, &e);
+    }
+
+    test_persistent_simplify_threads();
+
+    // Test canonical ordering and the expression store
+    printf("%s=== Testing canonical form and expression store ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    test_canonical("Commuted sum", Sum(&Var('y'), &Var('x')), Sum(&Var('x'), &Var('y')), "x+y");
+    test_canonical("Coefficient leads a product", Product(&Var('x'), &Const(2)), Product(&Const(2), &Var('x')), "2x");
+    test_canonical("Regrouped sum is flattened", Sum(&Var('z'), &Sum(&Var('y'), &Var('x'))), Sum(&Sum(&Var('x'), &Var('z')), &Var('y')), "(x+y)+z");
+    test_canonical("Nested operands are canonical too", Sin(&Product(&Sum(&Var('b'), &Var('a')), &Var('c'))),
+                   Sin(&Product(&Var('c'), &Sum(&Var('a'), &Var('b')))), "sin((a+b)c)");
+    test_canonical("Difference keeps its order", Difference(&Product(&Var('y'), &Var('x')), &Var('z')),
+                   Difference(&Product(&Var('x'), &Var('y')), &Var('z')), "x*y-z");
+
+    test_expr_store(200000);
+
+    // Test folding in the constructors
+    printf("%s=== Testing constructor folding ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    {
+        printf("=== Testing: constant trees fold as they are built ===\n");
+        total_tests++;
+
+        expr_t constant = Logarithm(&Const(2), &Power(&Sum(&Const(1), &Const(1)), &Negation(&Const(-5))));
+        expr_t mixed = Sum(&Var('x'), &Product(&Inverse(&Const(4)), &Const(8)));
+        expr_t raw = BinaryNode(EXPR_SUM, &Const(1), &Const(2));
+
+        bool test_passed = (constant.variant == EXPR_CONSTANT) && (fabs(constant.constant - 5.0) < 1e-12)
+            && (mixed.variant == EXPR_SUM) && (expr_variant(mixed.args.y) == EXPR_CONSTANT) && (expr_constant(mixed.args.y) == 2.0)
+            && (raw.variant == EXPR_SUM);
+
+        printf("%s%s log2((1+1)^-(-5)) is a constant node, x+(4^-1*8) carries a folded 2, BinaryNode stays a sum%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    {
+        printf("=== Testing: constant trees fold at compile time ===\n");
+        total_tests++;
+
+        bool o1 = constructor_folding_compiles("-O1"), o2 = constructor_folding_compiles("-O2");
+        bool o0 = constructor_folding_compiles("-O0");
+        bool test_passed = o1 && o2 && !o0;
+
+        printf("%s%s (2+3)*2^-(-3) is a compile time constant at -O1 %s, -O2 %s, and left for runtime at -O0 %s%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗",
+               o1 ? "yes" : "no", o2 ? "yes" : "no", o0 ? "no" : "yes", COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    test_expression("File scope tree from the raw constructors", file_scope_tree, "2+x*(-3)", INFINITY);
+
+    // Test inline leaves
+    printf("%s=== Testing inline leaves ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    test_expression("Inline constants fold", BinaryNode(EXPR_SUM, ConstLeaf(2), &BinaryNode(EXPR_PRODUCT, ConstLeaf(3), ConstLeaf(0.5))), "3.5", 3.5);
+    test_expression("Inline leaves serialize", Sum(&Product(ConstLeaf(2), VarLeaf('x')), &Sin(VarLeaf('y'))), "2x+sin(y)", INFINITY);
+    test_expression("Double negation of an inline leaf", Product(VarLeaf('x'), &Negation(&Negation(VarLeaf('y')))), "x*y", INFINITY);
+    test_persistent_simplify("Persistent fold through -(-c)",
+                             BinaryNode(EXPR_SUM, &UnaryNode(EXPR_NEGATION, &UnaryNode(EXPR_NEGATION, &Const(2))), ConstLeaf(3)), "5");
+
+    expr_t inline_expr = Sum(&Product(&Sin(VarLeaf('x')), &Power(VarLeaf('y'), ConstLeaf(3))),
+        &Quotient(&Logarithm(ConstLeaf(2), VarLeaf('x')), &Sum(&Exponential(VarLeaf('x'), VarLeaf('y')), &Tan(VarLeaf('y')))));
+
+    test_evaluate_batch("evaluate_batch on inline leaves", inline_expr, FASTMATH_STRICT, 0.0);
+    test_precision("f32 mode on inline leaves", inline_expr, EVALUATE_F32, 1e-4);
+    test_codegen("Codegen of inline leaves", Product(VarLeaf('x'), &Sum(VarLeaf('x'), ConstLeaf(1))), "x", "x + (0x1p+0)", 1);
+
+    {
+        printf("=== Testing: inline leaves save nodes ===\n");
+        total_tests++;
+
+        // a*x + b*y + 4: 9 nodes written out, 4 with the leaves inline (4 sorts first)
+        expr_t e = Sum(&Sum(&Product(&Var('a'), &Var('x')), &Product(&Var('b'), &Var('y'))), &Const(4));
+
+        usize before = __active_gpa_allocations;
+        expr_t *c = canonicalize_expr(&e, &gpa_allocator);
+        usize nodes = __active_gpa_allocations - before;
+
+        bool test_passed = (nodes == 4) && expr_is_inline(c->args.x->args.x) && (expr_constant(ConstLeaf(0.1)) == 0.1)
+            && !expr_is_inline(ConstLeaf(0.1)) && expr_is_inline(ConstLeaf(-1e30f));
+
+        printf("%s%s canonical a*x+b*y+4 takes %zu nodes%s\n\n",
+               test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", nodes, COLOR_RESET);
+        if (test_passed) passed_tests++;
+
+        free_expr(&gpa_allocator, c);
+    }
+    // Test derivatives and root finding
+    printf("%s=== Testing derivatives and root finding ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    test_derivative("d/dx of a polynomial", Sum(&Power(&Var('x'), &Const(3)), &Product(&Const(2), &Var('x'))), -3.0, 3.0);
+    test_derivative("d/dx of x sin(x)", Product(&Var('x'), &Sin(&Var('x'))), -3.0, 3.0);
+    test_derivative("d/dx of cos(x^2)/x", Quotient(&Cos(&Power(&Var('x'), &Const(2))), &Var('x')), 0.5, 3.0);
+    test_derivative("d/dx of x^x", Power(&Var('x'), &Var('x')), 0.5, 3.0);
+    test_derivative("d/dx of 2^x and log_x(3)", Sum(&Exponential(&Const(2), &Var('x')), &Logarithm(&Var('x'), &Const(3))), 1.5, 4.0);
+    test_derivative("d/dx of log_2(x) - tan(x)", Difference(&Logarithm(&Const(2), &Var('x')), &Tan(&Var('x'))), 0.1, 1.4);
+    test_derivative("d/dx of -1/(x+1)", Negation(&Inverse(&Sum(&Var('x'), ConstLeaf(1)))), 0.0, 3.0);
+
+    {
+        printf("=== Testing: chain rule leaves no 0 or 1 factors ===\n");
+        total_tests++;
+
+        expr_t e = Product(&Const(3), &Power(&Var('x'), &Const(2)));
+        expr_t *d = differentiate(&e, 'x', &gpa_allocator);
+
+        char serialized[64] = {0};
+        serialize_expr(serialized, d);
+        bool test_passed = strcmp(serialized, "3*2x") == 0;
+        printf("%s%s d/dx 3x^2 = %s%s\n\n", test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", serialized, COLOR_RESET);
+        if (test_passed) passed_tests++;
+
+        free_expr(&gpa_allocator, d);
+    }
+
+    expr_t sqrt2 = Difference(&Power(&Var('x'), &Const(2)), &Const(2));
+    u64 newton_iterations, halley_iterations;
+    test_roots("Newton on x^2 - 2", sqrt2, ROOT_NEWTON, 0.5, 100.0, M_SQRT2, &newton_iterations);
+    test_roots("Halley on x^2 - 2", sqrt2, ROOT_HALLEY, 0.5, 100.0, M_SQRT2, &halley_iterations);
+
+    {
+        printf("=== Testing: Halley takes fewer iterations than Newton ===\n");
+        total_tests++;
+
+        bool test_passed = halley_iterations < newton_iterations;
+        printf("%s%s %llu vs %llu iterations%s\n\n", test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗",
+               (unsigned long long)halley_iterations, (unsigned long long)newton_iterations, COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    u64 cos_iterations;
+    test_roots("Halley on cos(x) - x", Difference(&Cos(&Var('x')), &Var('x')), ROOT_HALLEY, -0.5, 1.5, 0.7390851332151607, &cos_iterations);
+
+    {
+        printf("=== Testing: x^2 + 1 never converges ===\n");
+        total_tests++;
+
+        usize n = 5000;
+        f64 starts[5000], roots[5000];
+        u32 iterations[5000];
+        root_status_t status[5000];
+        for (usize i = 0; i < n; i++) starts[i] = -10.0 + 20.0 * (f64)i / (f64)n + 1e-3;
+
+        expr_t e = Sum(&Power(&Var('x'), &Const(2)), &Const(1));
+        root_options_t options = { .method = ROOT_NEWTON, .tolerance = 1e-12, .max_iterations = 50, .accuracy = FASTMATH_STRICT };
+        find_roots(roots, iterations, status, &e, 'x', starts, n, options, &gpa_allocator);
+
+        bool test_passed = true;
+        for (usize i = 0; i < n; i++) {
+            test_passed = test_passed && (status[i] != ROOT_CONVERGED) && (iterations[i] <= 50)
+                && ((status[i] == ROOT_DIVERGED) || (iterations[i] == 50));
+        }
+
+        printf("%s%s no starting point reports a root%s\n\n", test_passed ? COLOR_GREEN : COLOR_RED, test_passed ? "✓" : "✗", COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+    // Test numerical integration
+    printf("%s=== Testing numerical integration ===%s\n", COLOR_YELLOW, COLOR_RESET);
+
+    {
+        f64 lower[] = { 0.0, 0.0, 0.0 }, upper[] = { M_PI, M_PI / 2.0, 1.0 };
+        f64 one[] = { 1.0 }, two[] = { 2.0 }, ten[] = { 10.0 };
+
+        test_integrate("sin(x) over [0, pi]", Sin(&Var('x')), "x", lower, upper, 1e-12, 0, 2.0);
+        test_integrate("sin(x) over [0, pi] on one thread", Sin(&Var('x')), "x", lower, upper, 1e-12, 1, 2.0);
+        test_integrate("x^x over [0, 1]", Power(&Var('x'), &Var('x')), "x", lower, one, 1e-10, 0, 0.78343051071213440706);
+        test_integrate("cos(20x) over [0, 10]", Cos(&Product(&Const(20), &Var('x'))), "x", lower, ten, 1e-10, 0, sin(200.0) / 20.0);
+        test_integrate("1/x from 2 down to 1", Inverse(&Var('x')), "x", two, one, 1e-12, 0, -M_LN2);
+        test_integrate("e^(x+y) over [0, 1]^2", Exponential(&Const(M_E), &Sum(&Var('x'), &Var('y'))), "xy", lower, (f64[]){ 1.0, 1.0 },
+                       1e-8, 0, (M_E - 1.0) * (M_E - 1.0));
+        test_integrate("sin(x) cos(y) z over a box", Product(&Product(&Sin(&Var('x')), &Cos(&Var('y'))), &Var('z')), "xyz",
+                       lower, upper, 1e-8, 0, 1.0);
+        test_integrate("1/(1+x^2+y^2) on one thread", Inverse(&Sum(&Sum(&Const(1), &Power(&Var('x'), &Const(2))), &Power(&Var('y'), &Const(2)))),
+                       "xy", lower, (f64[]){ 1.0, 1.0 }, 1e-8, 1, 0.6395103518703188);
+
+        printf("=== Testing: integrate() flags an integrand it can't evaluate ===\n");
+        total_tests++;
+
+        expr_t e = Logarithm(&Const(2), &Var('x'));
+        usize before = __atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED);
+        integral_t result = integrate(&e, 'x', -2.0, -1.0, 1e-10, &gpa_allocator);
+
+        bool test_passed = !result.converged && isnan(result.value) && (__atomic_load_n(&__active_gpa_allocations, __ATOMIC_RELAXED) == before);
+        printf("%s%s log_2(x) over [-2, -1] gives %g after %zu regions%s\n\n", test_passed ? COLOR_GREEN : COLOR_RED,
+               test_passed ? "✓" : "✗", result.value, result.regions, COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
+
+    {
+        printf("=== Testing: integration work is spread over the workers ===\n");
+        total_tests++;
+
+        integrate_options_t options = INTEGRATE_DEFAULTS;
+        options.threads = 4;
+
+        expr_t e = Cos(&Product(&Const(20), &Var('x')));
+        f64 lower[] = { 0.0 }, upper[] = { 10.0 };
+        integral_t result = integrate_with(&e, "x", lower, upper, 1e-10, options, &gpa_allocator);
+
+        bool test_passed = result.converged && (result.workers > 1) && (fabs(result.value - sin(200.0) / 20.0) <= 1e-10);
+        printf("%s%s %u of 4 workers evaluated regions, %zu regions in all%s\n\n", test_passed ? COLOR_GREEN : COLOR_RED,
+               test_passed ? "✓" : "✗", result.workers, result.regions, COLOR_RESET);
+        if (test_passed) passed_tests++;
+    }
     
     // Print final summary
     printf("%s=== TEST SUITE COMPLETE ===%s\n", COLOR_BOLD COLOR_BLUE, COLOR_RESET);